@@ -0,0 +1,49 @@
+#!/bin/bash
+# Compare the Cilk build with the std::thread NUMA scheduler build
+# (make SCHED=numa_sched) and the OpenMP build (make SCHED=openmp) on the
+# same inputs.
+#
+# usage: ./bench_sched.sh <graph> [app options...]
+#   e.g. ./bench_sched.sh rMatGraph_J_5_100 -c 384 -rounds 10 -s
+#
+# APPS selects the applications (default: all unweighted ones) and SCHEDS
+# the builds (default: cilk numa_sched openmp). Use the same number of
+# threads in all builds for a fair comparison: CILK_NWORKERS,
+# NUMA_SCHED_WORKERS and OMP_NUM_THREADS. OMP_PLACES defaults to sockets.
+# Prints the average time per round reported by each binary.
+
+GRAPH=$1
+shift
+if [ -z "$GRAPH" ]; then
+    echo "usage: $0 <graph> [app options...]"
+    exit 1
+fi
+APPS=${APPS:-"BFS BC Components PageRank PageRankDelta BP PageRankBit PageRankConverage"}
+SCHEDS=${SCHEDS:-"cilk numa_sched openmp"}
+export LD_LIBRARY_PATH=../cilk-swan/lib:$LD_LIBRARY_PATH
+export OMP_PLACES=${OMP_PLACES:-sockets}
+
+for sched in $SCHEDS; do
+    for app in $APPS; do
+        rm -f $app
+        if [ $sched = cilk ]; then
+            make $app > /dev/null || exit 1
+        else
+            make SCHED=$sched $app > /dev/null || exit 1
+        fi
+        mv $app $app.$sched
+    done
+done
+
+printf "%-20s" app
+for sched in $SCHEDS; do printf " %12s" $sched; done
+printf "\n"
+for app in $APPS; do
+    printf "%-20s" $app
+    for sched in $SCHEDS; do
+        t=$(./$app.$sched "$@" $GRAPH 2>/dev/null | awk '/^Average/ {print $3}')
+        printf " %12s" "$t"
+    done
+    printf "\n"
+    for sched in $SCHEDS; do rm -f $app.$sched; done
+done
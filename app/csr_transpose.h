@@ -0,0 +1 @@
+../graphgrind/csr_transpose.h
\ No newline at end of file
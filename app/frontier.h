@@ -0,0 +1 @@
+../graphgrind/frontier.h
\ No newline at end of file
@@ -0,0 +1 @@
+../graphgrind/numa_nodes.h
\ No newline at end of file
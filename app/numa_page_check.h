@@ -0,0 +1 @@
+../graphgrind/numa_page_check.h
\ No newline at end of file
@@ -0,0 +1 @@
+../graphgrind/numa_sched.h
\ No newline at end of file
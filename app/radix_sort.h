@@ -0,0 +1 @@
+../graphgrind/radix_sort.h
\ No newline at end of file
@@ -0,0 +1 @@
+../graphgrind/snapshot.h
\ No newline at end of file
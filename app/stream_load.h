@@ -0,0 +1 @@
+../graphgrind/stream_load.h
\ No newline at end of file
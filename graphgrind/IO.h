@@ -30,10 +30,13 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <cassert>
-#include <unistd.h>
+#include <cstring>
+#include <string>
+#include <stdint.h>
 
 #include "parallel.h"
 #include "quickSort.h"
+#include "csr_transpose.h"
 using namespace std;
 
 typedef pair<intE,intE> intPair;
@@ -51,24 +54,6 @@ struct pairFirstCmp
     }
 };
 
-// A structure that keeps a sequence of strings all allocated from
-// the same block of memory
-struct words
-{
-    intT n; // total number of characters
-    char* Chars;  // array storing all strings
-    intT m; // number of substrings
-    char** Strings; // pointers to strings (all should be null terminated)
-    words() {}
-    words(char* C, intT nn, char** S, intT mm)
-        : n(nn), Chars(C), m(mm), Strings(S) {}
-    void del()
-    {
-        delete [] Chars;
-        delete [] Strings;
-    }
-};
-
 inline bool isSpace(char c)
 {
     switch (c)
@@ -84,81 +69,226 @@ inline bool isSpace(char c)
     }
 }
 
-_seq<char> readStringFromFile(char *fileName)
+// Bytes of a text graph parsed by one task
+#ifndef TEXT_CHUNK
+#define TEXT_CHUNK (1<<20)
+#endif
+
+// Whether the 8 bytes at p are all decimal digits
+static inline bool eightDigits(const char *p)
 {
-    ifstream file (fileName, ios::in | ios::binary | ios::ate);
-    if (!file.is_open())
-    {
-        std::cout << "Unable to open file: " << fileName << std::endl;
-        abort();
-    }
-    intT end = file.tellg();
-    file.seekg (0, ios::beg);
-    intT n = end - file.tellg();
-    char* bytes = new char [n+1];
-    file.read (bytes,n);
-    file.close();
-    return _seq<char>(bytes,n);
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return (((v & 0xF0F0F0F0F0F0F0F0ULL)
+             | (((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4))
+            == 0x3333333333333333ULL);
 }
 
-// parallel code for converting a string to words
-words stringToWords(char *Str, intT n)
+// Value of the 8 digits at p, converted within one 64-bit word
+static inline uint64_t parseEightDigits(const char *p)
 {
-    {
-        parallel_for (intT i=0; i < n; i++)
-        if (isSpace(Str[i])) Str[i] = 0;
-    }
+    uint64_t v;
+    memcpy(&v, p, 8);
+    v -= 0x3030303030303030ULL;
+    v = (v * 10) + (v >> 8);
+    return (((v & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32)))
+            + (((v >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32))))
+        >> 32;
+}
 
-    // mark start of words
-    bool *FL = new bool [n];
-    FL[0] = Str[0];
+// Decimal number at p, with an optional minus sign. p is left on the
+// first byte after the number.
+static inline long parseLong(const char *& p, const char *end)
+{
+    bool neg = p < end && *p == '-';
+    if (neg) ++p;
+    uint64_t v = 0;
+    while (end - p >= 8 && eightDigits(p))
     {
-        parallel_for (intT i=1; i < n; i++) FL[i] = Str[i] && !Str[i-1];
+        v = v * 100000000 + parseEightDigits(p);
+        p += 8;
     }
+    while (p < end && (unsigned char)(*p - '0') < 10)
+        v = v * 10 + (*p++ - '0');
+    return neg ? -(long)v : (long)v;
+}
 
-    // offset for each start of word
-    _seq<intT> Off = sequence::packIndex<intT>(FL, n);
-    intT m = Off.n;
-    intT *offsets = Off.A;
+// A graph in the AdjacencyGraph (or WeightedAdjacencyGraph) text format,
+// parsed in place from a read-only mapping of the file. The header gives
+// n and m; parse() then stores the numbers that follow directly into the
+// offsets and edges arrays. The body is cut into chunks of TEXT_CHUNK
+// bytes that are processed in parallel in two passes: the numbers
+// starting in every chunk are counted, a scan of the counts gives the
+// index of the first number of every chunk, and each chunk then decodes
+// its numbers and stores them at their index. Neither a copy of the file
+// nor an array of tokens is made.
+class textGraph
+{
+    const char *data;
+    intT len;
+    intT body;  // first byte after the header
+    intT n, m;
 
-    // pointer to each start of word
-    char **SA = new char* [m];
+    // Numbers starting within [s,e)
+    intT countNumbers(intT s, intT e) const
     {
-        parallel_for (intT j=0; j < m; j++) SA[j] = Str+offsets[j];
+        intT c = 0;
+        bool space = isSpace(data[s-1]);
+        for (intT i=s; i < e; i++)
+        {
+            bool sp = isSpace(data[i]);
+            c += space && !sp;
+            space = sp;
+        }
+        return c;
     }
 
-    delete [] offsets;
-    delete [] FL;
-    return words(Str,n,SA,m);
-}
+public:
+    textGraph(char *fname)
+    {
+        int fd = open(fname, O_RDONLY);
+        if (fd < 0)
+        {
+            std::cout << "Unable to open file: " << fname << std::endl;
+            abort();
+        }
+        len = lseek(fd, 0, SEEK_END);
+        data = len > 0 ? (const char *)mmap(0, len, PROT_READ, MAP_PRIVATE, fd, 0)
+                       : (const char *)MAP_FAILED;
+        close(fd);
+        if (data == (const char *)MAP_FAILED)
+        {
+            cout << "Bad input file" << endl;
+            abort();
+        }
+        madvise((void *)data, len, MADV_WILLNEED);
 
-template <class vertex>
-wholeGraph<vertex> readGraphFromFile(char* fname, bool isSymmetric)
-{
-    _seq<char> S = readStringFromFile(fname);
-    words W = stringToWords(S.A, S.n);
+        const char *p = data, *end = data + len;
+        while (p < end && isSpace(*p)) p++;
+        const char *w = p;
+        while (p < end && !isSpace(*p)) p++;
 #ifndef WEIGHTED
-    if (W.Strings[0] != (string) "AdjacencyGraph")
+        if (string(w, p) != "AdjacencyGraph")
 #else
-    if (W.Strings[0] != (string) "WeightedAdjacencyGraph")
+        if (string(w, p) != "WeightedAdjacencyGraph")
 #endif
+        {
+            cout << "Bad input file" << endl;
+            abort();
+        }
+        while (p < end && isSpace(*p)) p++;
+        n = parseLong(p, end);
+        while (p < end && isSpace(*p)) p++;
+        m = parseLong(p, end);
+        body = p - data;
+    }
+    intT get_n() const
+    {
+        return n;
+    }
+    intT get_m() const
     {
-        cout << "Bad input file" << endl;
-        abort();
+        return m;
     }
 
-    intT len = W.m -1;
-    intT n = atol(W.Strings[1]);
-    intT m = atol(W.Strings[2]);
+    // offsets has n elements, edges m (2m with weights, interleaved)
+    void parse(intT *offsets, intE *edges)
+    {
+        intT nchunks = (len - body + TEXT_CHUNK - 1) / TEXT_CHUNK;
+        intT *first = new intT [nchunks+1];
+        {
+            parallel_range( (intT)0, nchunks, 1, [&]( intT c ) {
+                first[c] = countNumbers(body + c*TEXT_CHUNK,
+                                        std::min(body + (c+1)*TEXT_CHUNK, len));
+            } );
+        }
+        intT total = sequence::plusScan(first, first, nchunks);
+#ifndef WEIGHTED
+        if (total != n + m)
+#else
+        if (total != n + 2*m)
+#endif
+        {
+            cout << "Bad input file (n,m)" << endl;
+            abort();
+        }
+        const char *end = data + len;
+        {
+            parallel_range( (intT)0, nchunks, 1, [&]( intT c ) {
+                intT k = first[c];
+                intT s = body + c*TEXT_CHUNK;
+                intT e = std::min(s + TEXT_CHUNK, len);
+                bool space = isSpace(data[s-1]);
+                for (intT i=s; i < e; )
+                {
+                    if (isSpace(data[i]))
+                    {
+                        space = true;
+                        i++;
+                        continue;
+                    }
+                    if (!space)
+                    {
+                        i++;    // rest of a number begun before
+                        continue;
+                    }
+                    // numbers may run into the next chunk
+                    const char *p = data + i;
+                    long v = parseLong(p, end);
+                    i = p - data;
+                    space = false;
+                    if (k < n)
+                        offsets[k] = v;
 #ifndef WEIGHTED
-    if (len != n + m + 2)
+                    else
+                        edges[k-n] = v;
 #else
-    if (len != n + 2*m + 2)
+                    else if (k < n+m)
+                        edges[2*(k-n)] = v;
+                    else
+                        edges[2*(k-n-m)+1] = v;
 #endif
+                    k++;
+                }
+            } );
+        }
+        delete [] first;
+    }
+    void del()
     {
-        cout << "Bad input file (n,m)" << endl;
-        abort();
+        munmap((void *)data, len);
     }
+};
+
+// Build the in-edges of G, in G.inEdges, from its out-edges when there
+// is no transposed file. start(i) is the offset of the out-edges of vertex
+// i in edges.
+template <class vertex, class Start>
+void transposeGraph(wholeGraph<vertex> & G, Start start, const intE * edges)
+{
+    timer tm;
+    tm.start();
+    intT n = G.n;
+    intT* tOffsets = new intT [n];
+    intE* inEdges = G.inEdges;
+    csr_transpose::transpose<EDGE_WORDS>( n, G.m, start, edges,
+                                          tOffsets, inEdges );
+    parallel_range( (intT)0, n, 4096, [&]( intT i ) {
+        uintT o = tOffsets[i];
+        uintT l = ((i == n-1) ? G.m : tOffsets[i+1])-tOffsets[i];
+        G.V[i].setInDegree(l);
+        G.V[i].setInNeighbors(inEdges+EDGE_WORDS*o);
+    } );
+    delete [] tOffsets;
+    std::cerr << "transpose: " << tm.next() << "\n";
+}
+
+template <class vertex>
+wholeGraph<vertex> readGraphFromFile(char* fname, bool isSymmetric)
+{
+    textGraph T(fname);
+    intT n = T.get_n();
+    intT m = T.get_m();
 
     // Change in constructor: it now allocates all data structures in-place
     // based on n and m.
@@ -167,25 +297,11 @@ wholeGraph<vertex> readGraphFromFile(char* fname, bool isSymmetric)
 
     intT* offsets = new intT [n];
     intE* edges = WG.allocatedInplace;
-    {
-        parallel_for(intT i=0; i < n; i++) offsets[i] = atol(W.Strings[i + 3]);
-    }
-    {
-        parallel_for(intT i=0; i<m; i++)
-        {
-#ifndef WEIGHTED
-            edges[i] = atol(W.Strings[i+n+3]);
-#else
-            edges[2*i] = atol(W.Strings[i+n+3]);
-            edges[2*i+1] = atol(W.Strings[i+n+m+3]);
-#endif
-        }
-    }
-    W.del(); // to deal with performance bug in malloc
+    T.parse(offsets, edges);
+    T.del();
     vertex * V = WG.V;
     {
-        parallel_for (intT i=0; i < n; i++)
-        {
+        parallel_range( (intT)0, n, 4096, [&]( intT i ) {
             uintT o = offsets[i];
             uintT l = ((i == n-1) ? m : offsets[i+1])-offsets[i];
             V[i].setOutDegree(l);
@@ -194,7 +310,7 @@ wholeGraph<vertex> readGraphFromFile(char* fname, bool isSymmetric)
 #else
             V[i].setOutNeighbors(edges+2*o);
 #endif
-        }
+        } );
     }
 
     if(!isSymmetric)
@@ -209,47 +325,18 @@ wholeGraph<vertex> readGraphFromFile(char* fname, bool isSymmetric)
         struct stat buffer;
         if( stat( t_fname, &buffer ) == 0)
         {
-            _seq<char> S = readStringFromFile(t_fname);
-            words W = stringToWords(S.A, S.n);
-#ifndef WEIGHTED
-            if (W.Strings[0] != (string) "AdjacencyGraph")
-#else
-            if (W.Strings[0] != (string) "WeightedAdjacencyGraph")
-#endif
-            {
-                cout << "Bad input file (header)" << endl;
-                abort();
-            }
-
-
-            if( len != W.m-1 || atol(W.Strings[1]) != n
-                    || atol(W.Strings[2]) !=m )
+            textGraph T(t_fname);
+            if( T.get_n() != n || T.get_m() != m )
             {
                 cout << "Transpose not matching input file (n, m)" << endl;
                 abort();
             }
 
             intE* t_edges = WG.inEdges;
-
-            {
-                parallel_for(intT i=0; i < n; i++) offsets[i] = atol(W.Strings[i + 3]);
-            }
-            {
-                parallel_for(intT i=0; i<m; i++)
-                {
-#ifndef WEIGHTED
-                    t_edges[i] = atol(W.Strings[i+n+3]);
-#else
-                    t_edges[2*i] = atol(W.Strings[i+n+3]);
-                    t_edges[2*i+1] = atol(W.Strings[i+n+m+3]);
-#endif
-                }
-            }
-
-            W.del(); // to deal with performance bug in malloc
+            T.parse(offsets, t_edges);
+            T.del();
             {
-                parallel_for (intT i=0; i < n; i++)
-                {
+                parallel_range( (intT)0, n, 4096, [&]( intT i ) {
                     uintT o = offsets[i];
                     uintT l = ((i == n-1) ? m : offsets[i+1])-offsets[i];
                     V[i].setInDegree(l);
@@ -258,7 +345,7 @@ wholeGraph<vertex> readGraphFromFile(char* fname, bool isSymmetric)
 #else
                     V[i].setInNeighbors(t_edges+2*o);
 #endif
-                }
+                } );
             }
 
             delete [] offsets;
@@ -271,85 +358,8 @@ wholeGraph<vertex> readGraphFromFile(char* fname, bool isSymmetric)
             std::cerr << "Warning: using the transposed file speeds up "
                       << "graph loading\n";
 
-            intT* tOffsets = new intT [n];
-            {
-                parallel_for(intT i=0; i<n; i++) tOffsets[i] = INT_T_MAX;
-            }
-
-            intE* inEdges = WG.inEdges;
-
-#ifndef WEIGHTED
-            intPair* temp = new intPair [m];
-#else
-            intTriple* temp = new intTriple [m];
-#endif
-            {
-                parallel_for(intT i=0; i<n; i++)
-                {
-                    uintT o = offsets[i];
-                    for(intT j=0; j<V[i].getOutDegree(); j++)
-                    {
-#ifndef WEIGHTED
-                        temp[o+j] = make_pair(V[i].getOutNeighbor(j),i);
-#else
-                        temp[o+j] = make_pair(V[i].getOutNeighbor(j),make_pair(i,V[i].getOutWeight(j)));
-#endif
-                    }
-                }
-            }
+            transposeGraph( WG, [&]( intT i ) { return offsets[i]; }, edges );
             delete [] offsets;
-
-#ifndef WEIGHTED
-            quickSort(temp,m,pairFirstCmp<intE>());
-#else
-            quickSort(temp,m,pairFirstCmp<intPair>());
-#endif
-
-            tOffsets[0] = 0;
-    //        tOffsets[temp[0].first] = 0;
-#ifndef WEIGHTED
-            inEdges[0] = temp[0].second;
-#else
-            inEdges[0] = temp[0].second.first;
-            inEdges[1] = temp[0].second.second;
-#endif
-            {
-                parallel_for(intT i=1; i<m; i++)
-                {
-#ifndef WEIGHTED
-                    inEdges[i] = temp[i].second;
-#else
-                    inEdges[2*i] = temp[i].second.first;
-                    inEdges[2*i+1] = temp[i].second.second;
-#endif
-                    if(temp[i].first != temp[i-1].first)
-                    {
-                        tOffsets[temp[i].first] = i;
-                    }
-                }
-            }
-
-            delete [] temp;
-
-            //fill in offsets of degree 0 vertices by taking closest non-zero
-            //offset to the right
-            sequence::scanIBack(tOffsets,tOffsets,n,minF<intT>(),(intT)m);
-
-            {
-                parallel_for(intT i=0; i<n; i++)
-                {
-                    uintT o = tOffsets[i];
-                    uintT l = ((i == n-1) ? m : tOffsets[i+1])-tOffsets[i];
-                    V[i].setInDegree(l);
-#ifndef WEIGHTED
-                    V[i].setInNeighbors(inEdges+o);
-#else
-                    V[i].setInNeighbors(inEdges+2*o);
-#endif
-                }
-            }
-
-            delete [] tOffsets;
             return WG;//graph<vertex>(v,n,m,edges,inEdges);
         }
     }
@@ -361,207 +371,221 @@ wholeGraph<vertex> readGraphFromFile(char* fname, bool isSymmetric)
 }
 
 
-template <class vertex>
-wholeGraph<vertex> readGraphFromGalois(char* fname, bool isSymmetric)
-{
-    int fd;
+// Pages of a Galois file: 0 faulted in when first used, 1 read ahead
+// (MADV_WILLNEED) and touched in parallel, so that the pages not yet
+// cached are read by all threads and placed on their nodes, 2 populated
+// by mmap (MAP_POPULATE)
+#ifndef GALOIS_POPULATE
+#define GALOIS_POPULATE 1
+#endif
 
-    fd = open( fname, O_RDONLY );
-    if( (fd = open( fname, O_RDONLY )) < 0 )
-    {
-        std::cerr << "Error in Galois input file: cannot open '"
-                  << fname << "'\n";
-        abort();
-    }
-    intT len = lseek( fd, 0, SEEK_END );
-    if( len == (intT)-1 )
-    {
-        std::cerr << "Error in Galois input file in the sym: seek failed\n";
-        abort();
-    }
+// Use the destinations of unweighted Galois files in place, in the file
+// mapping, instead of copying them
+#ifndef GALOIS_ZERO_COPY
+#define GALOIS_ZERO_COPY 1
+#endif
 
-    // Could add MAP_POPULATE to preload all pages into memory
-    // Could add MAP_HUGETLB to use huge pages
-    const char * data = (const char *)mmap( 0, len, PROT_READ,
-                                            MAP_SHARED, fd, 0 );
-    if( data == (const char *)-1 )
-    {
-        std::cerr << "Cannot mmap input graph file\n";
-        abort();
-    }
+// A Galois binary graph file (version 1), mapped read-only: a header of
+// four 64-bit words (version, bytes of edge data, n, m), the end offset
+// of the edges of every vertex, the destinations, padded to an even
+// number, and the edge data (weights).
+struct galoisFile
+{
+    char *data;
+    size_t len;
+    bool kept;
+    intT n, m;
+    const intT *offsets;
+    const intE *dest;
+#ifdef WEIGHTED
+    const intE *weights;
+#endif
 
-    // 15/06/2016 Hans
-    // The header is a sequence of 4 64-bit integers.
-    // The best way to read 64-bit integers is to use a data type
-    // that is guaranteed to take 64-bit. int64_t and uint64_t are
-    // two portable integer data types defined in C for this purpose.
-    //uint32 for 4 bytes, uint64 for 8 bytes
-    intT * header = (intT*)&data[0];
-    // size_t * header = (size_t*)&data[0];
-    if( header[0] != 1 )
+    // Without populate, the pages are read on first use (GALOIS_POPULATE
+    // is ignored), e.g. by a stream_load::reader
+    galoisFile(const char *fname, bool populate=true) : kept( false )
     {
-        std::cerr << "Error in Galois input file: version ("
-                  << std::hex << header[0] << std::dec << ") != 1\n";
-        abort();
-    }
+        int fd = open( fname, O_RDONLY );
+        if( fd < 0 )
+        {
+            std::cerr << "Error in Galois input file: cannot open '"
+                      << fname << "'\n";
+            abort();
+        }
+        off_t size = lseek( fd, 0, SEEK_END );
+        if( size == (off_t)-1 )
+        {
+            std::cerr << "Error in Galois input file: seek failed\n";
+            abort();
+        }
+        len = size;
+        int flags = MAP_PRIVATE;
+#if GALOIS_POPULATE == 2
+        if( populate )
+            flags |= MAP_POPULATE;
+#endif
+        data = (char *)mmap( 0, len, PROT_READ, flags, fd, 0 );
+        close( fd );
+        if( data == (char *)MAP_FAILED )
+        {
+            std::cerr << "Cannot mmap input graph file\n";
+            abort();
+        }
+#if GALOIS_POPULATE == 1
+        if( populate )
+        {
+            madvise( data, len, MADV_WILLNEED );
+            long page = sysconf( _SC_PAGESIZE );
+            long pages = ( len + page - 1 ) / page;
+            volatile char sink = 0;
+            parallel_range( (long)0, pages, 64, [&]( long i ) {
+                    sink = data[i*page];
+                } );
+            (void)sink;
+        }
+#endif
 
-    intT n = (intT)header[2];
-    intT m = (intT)header[3];
-    bool wgh = ((intT)header[1]) == 4;
-    //cerr<<"m="<<m<<" and n="<<n<<"wgh="<<wgh<<endl;
+        // 15/06/2016 Hans
+        // The header is a sequence of 4 64-bit integers.
+        //uint32 for 4 bytes, uint64 for 8 bytes
+        const intT * header = (const intT*)&data[0];
+        if( len < 4*sizeof(header[0]) || header[0] != 1 )
+        {
+            std::cerr << "Error in Galois input file: version ("
+                      << std::hex << header[0] << std::dec << ") != 1\n";
+            abort();
+        }
+        n = header[2];
+        m = header[3];
+        bool wgh = header[1] == 4;
 #ifndef WEIGHTED
-    // We can ignore the weights in the file if we don't need them, but
-    // we cannot continue without weights if we expect them.
-    assert( !wgh );
+        // We can ignore the weights in the file if we don't need them, but
+        // we cannot continue without weights if we expect them.
+        assert( !wgh );
 #endif
-
-    wholeGraph<vertex> G(n, m, isSymmetric);
-    //graph<vertex> G( n, m , isSymmetric, -1);
-
-    //uint32 for 4 bytes, uint64 for 8 bytes
-    //size_t * offsets = (size_t*)(data + sizeof( header[0] ) * 4);
-    intT * offsets = (intT*)(data + sizeof( header[0] ) * 4);
-    //uint32 for 4 bytes, uint64 for 8 bytes
-    //uint32_t * edest
-    intE * edest
-        = (intE*)(data + sizeof( header[0] ) * 4 + sizeof( offsets[0] ) * n);
+        (void)wgh;
+        offsets = (const intT*)(data + sizeof( header[0] ) * 4);
+        dest = (const intE*)(data + sizeof( header[0] ) * 4
+                             + sizeof( offsets[0] ) * n);
 #ifdef WEIGHTED
-    //uint32 for 4 bytes, uint64 for 8 bytes
-    //uint32_t * ewght
-    intE * ewght
-        = (intE*)(data + sizeof( header[0] ) * 4
-                  + sizeof( offsets[0] ) * n
-                  + sizeof( edest[0] ) * ( m + (m&1) ));
+        weights = (const intE*)(data + sizeof( header[0] ) * 4
+                                + sizeof( offsets[0] ) * n
+                                + sizeof( dest[0] ) * ( m + (m&1) ));
 #endif
+    }
 
-    intE * edges = G.allocatedInplace;
-
+    // Edge array of the graph: the destinations in the mapping, when they
+    // have its layout (unweighted graphs, GALOIS_ZERO_COPY), which is then
+    // kept in map. Otherwise a copy in copy, made in parallel: NUMA node k
+    // takes its share of the edges (numa_nodes::topology::share(), as the
+    // partitions are shared out), bound to it and first touched by its
+    // own workers.
+    intE *edges( mmap_ptr<intE> & copy, file_map & map )
+    {
+#if GALOIS_ZERO_COPY && !defined(WEIGHTED)
+        map = file_map( data, len );
+        kept = true;
+        return const_cast<intE*>( dest );
+#else
+        partitioner part( num_numa_node, EDGE_WORDS*m );
+        for( int k=0; k < num_numa_node; ++k )
+            part.as_array()[k] = EDGE_WORDS
+                * ( numa_nodes::get().share( k+1, m ) - numa_nodes::get().share( k, m ) );
+        part.compute_starts();
+        copy.part_allocate(part);
+        intE *e = copy.get();
+        map_partitionL( part, [&]( int k ) {
+            intT s = part.start_of( k ) / EDGE_WORDS;
+            intT t = part.start_of( k+1 ) / EDGE_WORDS;
 #ifndef WEIGHTED
-    parallel_for(intT i=0; i<m; i++)
-    edges[i] = (intE)edest[i];
+            parallel_range( s, t, 4096, [&]( intT i ) { e[i] = dest[i]; } );
 #else
-    // Copy even though because we could re-use mmap data because we need
-    // to avoid disk accesses.
-    parallel_for(intT i=0; i<m; i++)
-    {
-        edges[2*i] = (intE)edest[i];
-        edges[2*i+1] = (intE)ewght[i];
-    }
+            parallel_range( s, t, 4096, [&]( intT i ) {
+                e[2*i] = dest[i];
+                e[2*i+1] = weights[i];
+            } );
+#endif
+        } );
+        return e;
 #endif
+    }
 
-//   vertex * v = G.V;
+    // Unmap the file, unless the graph uses it in place
+    void del()
+    {
+        if( !kept )
+            munmap( data, len );
+        data = 0;
+    }
+};
 
-    parallel_for(intT i=0; i<n; i++)
+// With stream, the edges are read in the background while the graph is
+// partitioned (see stream_load.h). This needs the edges in place in the
+// mappings and, for asymmetric graphs, a transposed file: otherwise the
+// whole input is read first.
+template <class vertex>
+wholeGraph<vertex> readGraphFromGalois(char* fname, bool isSymmetric, bool stream=false)
+{
+    timer tm;
+    tm.start();
+    int fnl = strlen(fname);
+    char t_fname[fnl+3];
+    strcpy( t_fname, fname );
+    strcpy( &t_fname[fnl], "_t" );
+    struct stat buffer;
+    bool t_exists = !isSymmetric && stat( t_fname, &buffer ) == 0;
+    if( stream && ( !( GALOIS_ZERO_COPY && EDGE_WORDS == 1 )
+                    || ( !isSymmetric && !t_exists ) ) )
     {
-        uintT o = i == 0 ? 0 : offsets[i-1];
-        //uintT o = offsets[i];
-        //uintT l = ((i==n-1) ? m : offsets[i+1])-offsets[i];
-        uintT l = offsets[i] - o;
+        std::cerr << "Warning: -stream needs an unweighted graph used in place"
+                  << " (GALOIS_ZERO_COPY) and, if asymmetric, a transposed"
+                  << " file; reading the whole input first\n";
+        stream = false;
+    }
+
+    galoisFile F(fname, !stream);
+    double t_map = tm.next();
+    intT n = F.n;
+    intT m = F.m;
+
+    wholeGraph<vertex> G(n, m, isSymmetric, false);
+    intE * edges = F.edges( G.allocatedInplace, G.outMap );
+    intE * t_edges = 0;
+    parallel_range( (intT)0, n, 4096, [&]( intT i ) {
+        uintT o = i == 0 ? 0 : F.offsets[i-1];
+        uintT l = F.offsets[i] - o;
         G.V[i].setOutDegree(l);
 #ifndef WEIGHTED
-        //G.V[i].setOutNeighbors(&edges[o]);
         G.V[i].setOutNeighbors(edges+o);
 #else
-        //G.V[i].setOutNeighbors(&edges[2*o]);
         G.V[i].setOutNeighbors(edges+2*o);
 #endif
-    }
+    } );
+    double t_out = tm.next();
 
     if( !isSymmetric )
     {
-        int fnl = strlen(fname);
-        char t_fname[fnl+3];
-        strcpy( t_fname, fname );
-        strcpy( &t_fname[fnl], "_t" );
-        struct stat buffer;
-        if( stat( t_fname, &buffer ) == 0)
+        if( t_exists )
         {
-    	    munmap( (void*)data, len );
-    	    close( fd );
-            fd = open(t_fname, O_RDONLY);
-            if( fd < 0 )
-            {
-                std::cerr << "Error in Galois t-input file: cannot open '"
-                          << t_fname << "'\n";
-                abort();
-            }
-            intT len = lseek( fd, 0, SEEK_END );
-            if( len == (intT)-1 )
-            {
-                std::cerr << "Error in Galois input file: seek failed\n";
-                abort();
-            }
-
-            // Could add MAP_POPULATE to preload all pages into memory
-            // Could add MAP_HUGETLB to use huge pages
-            const char * tdata
-                = (const char *)mmap( 0, len, PROT_READ,
-                                      MAP_SHARED, fd, 0 );
-            if( tdata == (const char *)-1 )
-            {
-                std::cerr << "Cannot mmap input graph file\n";
-                abort();
-            }
-
-            //uint32 for 4 bytes, uint64 for 8 bytes
-            intT * theader = (intT*)&tdata[0];
-
-            if( theader[0] != 1 )
-            {
-                std::cerr << "Error in Galois input file: version ("
-                          << std::hex << theader[0] << std::dec << ") != 1\n";
-                abort();
-            }
-            if( n != (intT)theader[2] || m != (intT)theader[3] )
+            galoisFile T(t_fname, !stream);
+            if( n != T.n || m != T.m )
             {
                 std::cerr << "Mismatch in Galois input files on n/m\n";
                 abort();
             }
-
-            intT * t_offsets = (intT*)(tdata + sizeof( theader[0] ) * 4);
-            //uint32 for 4 bytes, uint64 for 8 bytes
-            //intE * edest
-            intE * tedest
-                = (intE*)(tdata + sizeof( theader[0] ) * 4
-                              + sizeof( t_offsets[0] ) * n);
-#ifdef WEIGHTED
-            //uint32 for 4 bytes, uint64 for 8 bytes
-            intE * tewght
-                = (intE*)(tdata + sizeof( theader[0] ) * 4
-                              + sizeof( t_offsets[0] ) * n
-                              + sizeof( tedest[0] ) * ( m + (m&1) ));
-#endif
-
-            intE * t_edges = G.inEdges;
-
-#ifndef WEIGHTED
-            parallel_for(intT i=0; i<m; i++)
-            t_edges[i] = (intE) tedest[i];
-#else
-            // Copy even though we could re-use mmap data because we need
-            // to avoid disk accesses.
-            parallel_for(intT i=0; i<m; i++)
-            {
-                t_edges[2*i] = (intE)tedest[i];
-                t_edges[2*i+1] = (intE)tewght[i];
-            }
-#endif
-            parallel_for(intT i=0; i<n; i++)
-            {
-                uintT o = i == 0 ? 0 : t_offsets[i-1];
-                //uintT o = t_offsets[i];
-                //uintT l = ((i==n-1) ? m : t_offsets[i+1])-t_offsets[i];
-                uintT l = t_offsets[i] - o;
+            t_map += tm.next();
+            t_edges = T.edges( G.inEdges, G.inMap );
+            parallel_range( (intT)0, n, 4096, [&]( intT i ) {
+                uintT o = i == 0 ? 0 : T.offsets[i-1];
+                uintT l = T.offsets[i] - o;
                 G.V[i].setInDegree(l);
 #ifndef WEIGHTED
                 G.V[i].setInNeighbors(t_edges+o);
 #else
                 G.V[i].setInNeighbors(t_edges+2*o);
 #endif
-            }
-            munmap( (void*)tdata, len );
-            close(fd);
-            return G;
+            } );
+            T.del();
         }
         else
         {
@@ -569,97 +593,40 @@ wholeGraph<vertex> readGraphFromGalois(char* fname, bool isSymmetric)
                       << "' does not exist for asymmetric graph\n";
             std::cerr << "Warning: using the transposed file speeds up "
                       << "graph loading\n";
-            intT* tOffsets = new intT [n];
-            {
-                parallel_for(intT i=0; i<n; i++) tOffsets[i] = INT_T_MAX;
-            }
-            intE* inEdges = G.inEdges;
-
 #ifndef WEIGHTED
-            intPair* temp = new intPair [m];
+            G.inEdges.Interleave_allocate(m);
 #else
-            intTriple* temp = new intTriple [m];
+            G.inEdges.Interleave_allocate(2*m);
 #endif
-            {
-                parallel_for(intT i=0; i<n; i++)
-                {
-                    uintT o = i == 0 ? 0 : offsets[i-1];
-                    for(intT j=0; j<G.V[i].getOutDegree(); j++)
-                    {
-#ifndef WEIGHTED
-                        temp[o+j] = make_pair(G.V[i].getOutNeighbor(j),i);
-#else
-                        temp[o+j] = make_pair(G.V[i].getOutNeighbor(j),make_pair(i,G.V[i].getOutWeight(j)));
-#endif
-                    }
-                }
-            }
-#ifndef WEIGHTED
-            quickSort(temp,m,pairFirstCmp<intE>());
-#else
-            quickSort(temp,m,pairFirstCmp<intPair>());
-#endif
-            //tOffsets[0] = 0;
-            tOffsets[temp[0].first] = 0;
-#ifndef WEIGHTED
-            inEdges[0] = temp[0].second;
-#else
-            inEdges[0] = temp[0].second.first;
-            inEdges[1] = temp[0].second.second;
-#endif
-            parallel_for(intT i=1; i<m; i++)
-            {
-#ifndef WEIGHTED
-                inEdges[i] = temp[i].second;
-#else
-                inEdges[2*i] = temp[i].second.first;
-                inEdges[2*i+1] = temp[i].second.second;
-#endif
-                if(temp[i].first != temp[i-1].first)
-                {
-                    tOffsets[temp[i].first] = i;
-                }
-            }
-
-            delete [] temp;
-
-            //fill in offsets of degree 0 vertices by taking closest non-zero
-            //offset to the right
-            sequence::scanIBack(tOffsets,tOffsets,n,minF<intT>(),(intT)m);
-
-            {
-                parallel_for(intT i=0; i<n; i++)
-                {
-                    uintT o = tOffsets[i];
-                    uintT l = ((i == n-1) ? m : tOffsets[i+1])-tOffsets[i];
-                    G.V[i].setInDegree(l);
-#ifndef WEIGHTED
-                    G.V[i].setInNeighbors(inEdges+o);
-#else
-                    G.V[i].setInNeighbors(inEdges+2*o);
-#endif
-                }
-            }
-
-            munmap( (void*)data, len );
-            close (fd);
-            delete [] tOffsets;
-            return G;
+            const intT * offsets = F.offsets;
+            transposeGraph( G, [=]( intT i ) {
+                    return i == 0 ? 0 : offsets[i-1];
+                }, edges );
         }
     }
-    else
+    F.del();
+    if( stream )
     {
-        munmap( (void*)data, len );
-        close (fd);
-        return G;
+        G.stream = new stream_load::reader;
+        G.stream->add( edges, sizeof(intE)*m );
+        if( t_edges )
+            G.stream->add( t_edges, sizeof(intE)*m );
+        G.stream->start();
     }
+    std::cerr << "Galois loading: map " << t_map << " out-edges " << t_out
+              << " in-edges " << tm.next()
+              << ( stream ? " (streamed)" : G.outMap.addr ? " (in place)" : " (copied)" )
+              << "\n";
+    return G;
 }
 
 template <class vertex>
-wholeGraph<vertex> readGraph(char* iFile, bool symmetric, bool binary)
+wholeGraph<vertex> readGraph(char* iFile, bool symmetric, bool binary, bool stream=false)
 {
     // if(binary) return readGraphFromBinary<vertex>(iFile,symmetric);
-    if(binary) return readGraphFromGalois<vertex>(iFile,symmetric);
-    else return readGraphFromFile<vertex>(iFile,symmetric);
+    if(binary) return readGraphFromGalois<vertex>(iFile,symmetric,stream);
+    if(stream)
+        std::cerr << "Warning: -stream only applies to Galois binary graphs (-b)\n";
+    return readGraphFromFile<vertex>(iFile,symmetric);
 }
 
@@ -0,0 +1,116 @@
+// -*- C++ -*-
+// Transpose of a graph in CSR format: the in-edges of every vertex are
+// built from the out-edges in linear time, without sorting all edges.
+//
+// The in-degrees are counted with atomic increments, turned into offsets
+// with a parallel prefix sum, and every edge is then scattered to the
+// next free slot of its destination (one cursor per vertex). The slots are
+// taken in an order that depends on the scheduling, so the in-edges of
+// every vertex are finally sorted by source; this keeps the result
+// deterministic and only sorts lists of the size of a vertex degree.
+//
+// Apart from the arrays passed in, only one cursor per vertex is
+// allocated. The functions do not depend on the graph classes of
+// GraphGrind (readGraphFromFile() and readGraphFromGalois() in IO.h use
+// them, and so does graphtools/adjTranspose to write _t files). This file
+// relies on parallel.h having been included before.
+#ifndef CSR_TRANSPOSE_H
+#define CSR_TRANSPOSE_H
+
+#include <algorithm>
+
+namespace csr_transpose
+{
+
+// An edge of words elements: the neighbour, then the weight if any. Edges
+// are compared on all elements so that parallel edges sort the same way in
+// every run.
+template<class E, int words>
+struct record
+{
+    E w[words];
+    bool operator < ( const record & r ) const
+    {
+        return std::lexicographical_compare( w, w+words, r.w, r.w+words );
+    }
+};
+
+// In-place exclusive prefix sum of A[0,n); returns the total
+template<class I>
+I scan( I * A, I n )
+{
+    const I bsize = 1 << 16;
+    I nb = ( n + bsize - 1 ) / bsize;
+    I *sums = new I [nb+1];
+    parallel_range( (I)0, nb, 1, [&]( I b ) {
+        I s = 0, e = std::min( n, ( b + 1 ) * bsize );
+        for( I i=b*bsize; i < e; ++i )
+            s += A[i];
+        sums[b] = s;
+    } );
+    I total = 0;
+    for( I b=0; b < nb; ++b )
+    {
+        I s = sums[b];
+        sums[b] = total;
+        total += s;
+    }
+    parallel_range( (I)0, nb, 1, [&]( I b ) {
+        I s = sums[b], e = std::min( n, ( b + 1 ) * bsize );
+        for( I i=b*bsize; i < e; ++i )
+        {
+            I a = A[i];
+            A[i] = s;
+            s += a;
+        }
+    } );
+    delete [] sums;
+    return total;
+}
+
+// Transpose of the graph with n vertices and m edges whose out-edges of
+// vertex u are edges[start(u)*words, end*words), with end = start(u+1), or
+// m for the last vertex. On return, the in-edges of vertex v are
+// tEdges[tOffsets[v]*words, ...), in the same format and sorted by
+// source. tOffsets has n elements and tEdges m*words.
+template<int words, class I, class E, class Start>
+void transpose( I n, I m, Start start, const E * edges,
+                I * tOffsets, E * tEdges )
+{
+    parallel_range( (I)0, n, 4096, [&]( I v ) { tOffsets[v] = 0; } );
+
+    // In-degrees
+    parallel_range( (I)0, n, 1024, [&]( I u ) {
+        I e = u == n-1 ? m : start( u+1 );
+        for( I j=start( u ); j < e; ++j )
+            __sync_fetch_and_add( &tOffsets[edges[j*words]], (I)1 );
+    } );
+    scan( tOffsets, n );
+
+    // Scatter
+    I *cursor = new I [n];
+    parallel_range( (I)0, n, 4096, [&]( I v ) { cursor[v] = tOffsets[v]; } );
+    parallel_range( (I)0, n, 1024, [&]( I u ) {
+        I e = u == n-1 ? m : start( u+1 );
+        for( I j=start( u ); j < e; ++j )
+        {
+            I k = __sync_fetch_and_add( &cursor[edges[j*words]], (I)1 );
+            tEdges[k*words] = u;
+            for( int w=1; w < words; ++w )
+                tEdges[k*words+w] = edges[j*words+w];
+        }
+    } );
+    delete [] cursor;
+
+    // Sources in order
+    typedef record<E,words> R;
+    R *rec = reinterpret_cast<R *>( tEdges );
+    parallel_range( (I)0, n, 1024, [&]( I v ) {
+        I e = v == n-1 ? m : tOffsets[v+1];
+        std::sort( rec + tOffsets[v], rec + e );
+    } );
+}
+
+} // namespace csr_transpose
+
+#endif // CSR_TRANSPOSE_H
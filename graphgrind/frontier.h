@@ -0,0 +1,810 @@
+// -*- C++ -*-
+// Dense frontier representation for partitioned_vertices.
+//
+// Two layouts are available, selected at compile time:
+//   FRONTIER_BITMAP=0 : one bool per vertex (original layout)
+//   FRONTIER_BITMAP=1 : one bit per vertex, 64 vertices per word
+//
+// The bitmap is allocated along the COO partitioner with every partition
+// owning a whole number of words (see partitioner::align_boundaries()),
+// so a thread that only writes vertices of its own partition does not
+// need atomics. Writes that may cross partitions go through
+// counting_frontier, which uses an atomic OR.
+//
+// Every chunk of 64 vertices records whether it holds an active vertex
+// (chunk_active()), for active_summary: in the bitmap this is its word,
+// with bools a flag set along with the vertices.
+//
+// This file relies on utils.h, mm.h and partitioner.h having been
+// included before (as done by ligra-numa.h).
+#ifndef FRONTIER_H
+#define FRONTIER_H
+
+#include <stdint.h>
+#include <vector>
+
+#ifndef FRONTIER_BITMAP
+#define FRONTIER_BITMAP 0
+#endif
+
+#if defined(CILK) || defined(CILKP)
+#include <cilk/cilk_api.h>
+static inline int getWorkers() { return __cilkrts_get_nworkers(); }
+static inline int getWorkerNum() { return __cilkrts_get_worker_number(); }
+#elif defined(NUMA_SCHED)
+static inline int getWorkers() { return numa_sched::num_workers(); }
+static inline int getWorkerNum() { return numa_sched::worker_id(); }
+#elif defined(OPENMP) && NUMA
+// Threads of the nested per-node teams of map_partitionL() are numbered
+// by node, other parallel loops use a single team
+static inline int getWorkers() { return omp_num_threads(); }
+static inline int getWorkerNum()
+{
+    if( omp_get_active_level() >= 2 )
+        return omp_node_thread( omp_get_ancestor_thread_num( 1 ) )
+            + omp_get_ancestor_thread_num( 2 );
+    return omp_get_active_level() ? omp_get_ancestor_thread_num( 1 ) : 0;
+}
+#elif defined(OPENMP)
+static inline int getWorkers() { return omp_get_max_threads(); }
+static inline int getWorkerNum()
+{
+    return omp_get_active_level() ? omp_get_ancestor_thread_num( 1 ) : 0;
+}
+#else
+static inline int getWorkers() { return 1; }
+static inline int getWorkerNum() { return 0; }
+#endif
+
+// Granularity of active_summary, one word of the bitmap
+#define FRONTIER_LOG_CHUNK 6
+
+#if FRONTIER_BITMAP
+#define FRONTIER_LOG_WORD_BITS 6
+#define FRONTIER_WORD_BITS (1 << FRONTIER_LOG_WORD_BITS)
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+class dense_frontier
+{
+    mmap_ptr<uint64_t> words;
+    intT num_words;
+
+    static uint64_t mask( intT v )
+    {
+        return uint64_t(1) << ( v & (FRONTIER_WORD_BITS-1) );
+    }
+    static intT word_of( intT v )
+    {
+        return v >> FRONTIER_LOG_WORD_BITS;
+    }
+    // Words [first_word(s), first_word(e)) hold the vertices [s,e)
+    // of an aligned partition.
+    static intT first_word( intT v )
+    {
+        return ( v + FRONTIER_WORD_BITS-1 ) >> FRONTIER_LOG_WORD_BITS;
+    }
+
+    // Number of set bits in W[s,e). AVX2 counts the bits of every byte
+    // with a nibble lookup table; SSE2 without the popcnt instruction
+    // (x86-64 baseline, where __builtin_popcountll is a library call)
+    // folds pairs, nibbles and bytes within 128-bit registers.
+    static intT count_bits( const uint64_t *W, intT s, intT e )
+    {
+        intT c = 0;
+        intT i = s;
+#if defined(__AVX2__)
+        const __m256i lut = _mm256_setr_epi8( 0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,
+                                              0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4 );
+        const __m256i low = _mm256_set1_epi8( 0x0f );
+        __m256i acc = _mm256_setzero_si256();
+        for( ; i+4 <= e; i += 4 )
+        {
+            __m256i v = _mm256_loadu_si256( (const __m256i *)&W[i] );
+            __m256i n = _mm256_add_epi8(
+                _mm256_shuffle_epi8( lut, _mm256_and_si256( v, low ) ),
+                _mm256_shuffle_epi8( lut, _mm256_and_si256(
+                                         _mm256_srli_epi16( v, 4 ), low ) ) );
+            acc = _mm256_add_epi64( acc, _mm256_sad_epu8( n, _mm256_setzero_si256() ) );
+        }
+        uint64_t a[4];
+        _mm256_storeu_si256( (__m256i *)a, acc );
+        c = a[0] + a[1] + a[2] + a[3];
+#elif defined(__SSE2__) && !defined(__POPCNT__)
+        const __m128i m1 = _mm_set1_epi8( 0x55 );
+        const __m128i m2 = _mm_set1_epi8( 0x33 );
+        const __m128i m4 = _mm_set1_epi8( 0x0f );
+        __m128i acc = _mm_setzero_si128();
+        for( ; i+2 <= e; i += 2 )
+        {
+            __m128i v = _mm_loadu_si128( (const __m128i *)&W[i] );
+            v = _mm_sub_epi8( v, _mm_and_si128( _mm_srli_epi64( v, 1 ), m1 ) );
+            v = _mm_add_epi8( _mm_and_si128( v, m2 ),
+                              _mm_and_si128( _mm_srli_epi64( v, 2 ), m2 ) );
+            v = _mm_and_si128( _mm_add_epi8( v, _mm_srli_epi64( v, 4 ) ), m4 );
+            acc = _mm_add_epi64( acc, _mm_sad_epu8( v, _mm_setzero_si128() ) );
+        }
+        uint64_t a[2];
+        _mm_storeu_si128( (__m128i *)a, acc );
+        c = a[0] + a[1];
+#endif
+        for( ; i < e; ++i )
+            c += __builtin_popcountll( W[i] );
+        return c;
+    }
+    // First word in [i,e) that is not zero, or e. Runs of idle words are
+    // tested four (AVX2) or two (SSE2) at a time.
+    static intT next_nonzero( const uint64_t *W, intT i, intT e )
+    {
+        if( i < e && W[i] )
+            return i;
+#if defined(__AVX2__)
+        for( ; i+4 <= e; i += 4 )
+        {
+            __m256i v = _mm256_loadu_si256( (const __m256i *)&W[i] );
+            if( !_mm256_testz_si256( v, v ) )
+                break;
+        }
+#elif defined(__SSE2__)
+        for( ; i+2 <= e; i += 2 )
+        {
+            __m128i v = _mm_loadu_si128( (const __m128i *)&W[i] );
+            if( _mm_movemask_epi8( _mm_cmpeq_epi8( v, _mm_setzero_si128() ) ) != 0xffff )
+                break;
+        }
+#endif
+        while( i < e && !W[i] )
+            ++i;
+        return i;
+    }
+
+    // Statistics of a single word: active vertices and their out-degree
+    template<class vertex>
+    struct WordStats
+    {
+        const uint64_t *W;
+        vertex *V;
+        WordStats( const uint64_t *W_, vertex *V_ ) : W( W_ ), V( V_ ) { }
+        intTpair operator() ( intT i )
+        {
+            uint64_t w = W[i];
+            intT cnt = __builtin_popcountll( w );
+            intT deg = 0;
+            while( w )
+            {
+                intT v = ( i << FRONTIER_LOG_WORD_BITS ) + __builtin_ctzll( w );
+                deg += V[v].getOutDegree();
+                w &= w - 1;
+            }
+            return make_pair( cnt, deg );
+        }
+    };
+
+public:
+    dense_frontier() : num_words( 0 ) { }
+
+    void allocate( partitioner_view part )
+    {
+        const intT n = part.get_num_elements();
+        for( int p=1; p < part.get_num_partitions(); ++p )
+        {
+            intT s = part.start_of( p );
+            assert( s % FRONTIER_WORD_BITS == 0 || s == n );
+        }
+        num_words = first_word( n );
+        words.part_allocate_packed( part, FRONTIER_WORD_BITS );
+    }
+    void del()
+    {
+        words.del();
+        num_words = 0;
+    }
+    operator bool () const
+    {
+        return words;
+    }
+
+    bool operator[] ( intT v ) const
+    {
+        return ( words.get()[word_of( v )] & mask( v ) ) != 0;
+    }
+    // Only valid when no other thread writes to the word holding v,
+    // e.g. when v is owned by the partition being traversed sequentially.
+    // Both set() variants return true if v was not active before.
+    bool set( intT v )
+    {
+        uint64_t *w = &words.get()[word_of( v )];
+        if( *w & mask( v ) )
+            return false;
+        *w |= mask( v );
+        return true;
+    }
+    bool set_atomic( intT v )
+    {
+        uint64_t *w = &words.get()[word_of( v )];
+        if( *w & mask( v ) )
+            return false;
+        return !( __sync_fetch_and_or( w, mask( v ) ) & mask( v ) );
+    }
+
+    void clear( partitioner_view part )
+    {
+        uint64_t *W = words.get();
+        map_partitionL( part, [&]( int p ) {
+            intT ws = first_word( part.start_of( p ) );
+            intT we = first_word( part.start_of( p+1 ) );
+            std::fill( &W[ws], &W[we], uint64_t(0) );
+        } );
+    }
+
+    // d[v] = pred(v) for all v. Words are built one at a time by the
+    // partition that owns them, so the stores are not atomic.
+    template<class Pred>
+    void fill( partitioner_view part, Pred pred )
+    {
+        uint64_t *W = words.get();
+        map_partitionL( part, [&]( int p ) {
+            intT s = part.start_of( p );
+            intT e = part.start_of( p+1 );
+            intT ws = first_word( s );
+            intT we = first_word( e );
+            parallel_range( ws, we, 64, [&]( intT i ) {
+                intT vs = i << FRONTIER_LOG_WORD_BITS;
+                intT ve = std::min( vs + FRONTIER_WORD_BITS, e );
+                uint64_t w = 0;
+                for( intT v=vs; v < ve; ++v )
+                    if( pred( v ) )
+                        w |= mask( v );
+                W[i] = w;
+            } );
+        } );
+    }
+
+    // Number of active vertices (population count) among the vertices
+    // [s,e) of a partition of the partitioner used in allocate(), and the
+    // sum of their out-degrees
+    template<class vertex>
+    intTpair range_stats( vertex *V, intT s, intT e ) const
+    {
+        // sequence::reduce() is not defined on empty ranges
+        if( first_word( s ) == first_word( e ) )
+            return make_pair( (intT)0, (intT)0 );
+        return sequence::reduce<intT>( first_word( s ), first_word( e ),
+                                       WordStats<vertex>( words.get(), V ) );
+    }
+
+    // Any active vertex among [c*64,(c+1)*64)
+    bool chunk_active( intT c ) const
+    {
+        return words.get()[c] != 0;
+    }
+
+    // Copy (or clear) the vertices [s,e) of a partition of the
+    // partitioner used in allocate()
+    void copy_range( const dense_frontier & src, intT s, intT e )
+    {
+        uint64_t *W = words.get();
+        const uint64_t *S = src.words.get();
+        parallel_range( first_word( s ), first_word( e ), 1024,
+                        [&]( intT i ) { W[i] = S[i]; } );
+    }
+    void clear_range( intT s, intT e )
+    {
+        uint64_t *W = words.get();
+        std::fill( &W[first_word( s )], &W[first_word( e )], uint64_t(0) );
+    }
+
+    // Indices of the active vertices, in increasing order. Each block
+    // of words is counted (count_bits()), the counts are scanned and each
+    // block then extracts the set bits of its non-zero words
+    // (next_nonzero()) with count-trailing-zeros.
+    _seq<intT> pack( intT n ) const
+    {
+        const uint64_t *W = words.get();
+        intT s = 0, e = num_words;
+        intT l = nblocks( e, _SCAN_BSIZE );
+        intT *Sums = new intT [l];
+        blocked_for( b, s, e, _SCAN_BSIZE,
+                     Sums[b] = count_bits( W, s, e ); );
+        intT m = sequence::plusScan( Sums, Sums, l );
+        intT *Out = new intT [m];
+        blocked_for( b, s, e, _SCAN_BSIZE,
+                     {
+                         intT k = Sums[b];
+                         for( intT i=next_nonzero( W, s, e ); i < e;
+                              i=next_nonzero( W, i+1, e ) )
+                         {
+                             uint64_t w = W[i];
+                             while( w )
+                             {
+                                 Out[k++] = ( i << FRONTIER_LOG_WORD_BITS )
+                                            + __builtin_ctzll( w );
+                                 w &= w - 1;
+                             }
+                         }
+                     } );
+        delete [] Sums;
+        return _seq<intT>( Out, m );
+    }
+};
+
+#else // FRONTIER_BITMAP
+
+class dense_frontier
+{
+    mmap_ptr<bool> flags;
+    mmap_ptr<bool> chunks;  // any flag set among [c*64,(c+1)*64)
+
+    static intT chunk_of( intT v )
+    {
+        return v >> FRONTIER_LOG_CHUNK;
+    }
+    // Chunks [s,e) lie within the vertices [s,e)
+    static intT first_chunk( intT v )
+    {
+        return ( v + (1<<FRONTIER_LOG_CHUNK) - 1 ) >> FRONTIER_LOG_CHUNK;
+    }
+    static intT last_chunk( intT v )
+    {
+        return v >> FRONTIER_LOG_CHUNK;
+    }
+    void clear_chunks( partitioner_view part )
+    {
+        bool *c = chunks.get();
+        parallel_range( (intT)0, first_chunk( part.get_num_elements() ), 4096,
+                        [&]( intT k ) { c[k] = false; } );
+    }
+    // Concurrent stores of the same value are benign
+    void mark( intT v )
+    {
+        bool *c = &chunks.get()[chunk_of( v )];
+        if( !*c )
+            *c = true;
+    }
+
+    template<class vertex>
+    struct VertexStats
+    {
+        const bool *d;
+        vertex *V;
+        VertexStats( const bool *d_, vertex *V_ ) : d( d_ ), V( V_ ) { }
+        intTpair operator() ( intT i )
+        {
+            return make_pair( (intT)d[i], d[i] ? V[i].getOutDegree() : (intT)0 );
+        }
+    };
+
+public:
+    dense_frontier() { }
+
+    void allocate( partitioner_view part )
+    {
+        flags.part_allocate( part );
+        // n/64 bytes, not worth binding per partition
+        chunks.Interleave_allocate( first_chunk( part.get_num_elements() ) );
+    }
+    void del()
+    {
+        flags.del();
+        chunks.del();
+    }
+    operator bool () const
+    {
+        return flags;
+    }
+
+    bool operator[] ( intT v ) const
+    {
+        return flags.get()[v];
+    }
+    bool set( intT v )
+    {
+        bool *f = &flags.get()[v];
+        if( *f )
+            return false;
+        *f = 1;
+        mark( v );
+        return true;
+    }
+    // Concurrent byte stores of the same value would be benign, but only
+    // one writer may report the activation
+    bool set_atomic( intT v )
+    {
+        bool *f = &flags.get()[v];
+        if( *f || !__sync_bool_compare_and_swap( f, false, true ) )
+            return false;
+        mark( v );
+        return true;
+    }
+
+    void clear( partitioner_view part )
+    {
+        bool *d = flags.get();
+        map_vertexL( part, [&]( intT j ) { d[j] = 0; } );
+        clear_chunks( part );
+    }
+
+    template<class Pred>
+    void fill( partitioner_view part, Pred pred )
+    {
+        bool *d = flags.get();
+        clear_chunks( part );
+        map_vertexL( part, [&]( intT j ) {
+                if( ( d[j] = pred( j ) ) )
+                    mark( j );
+            } );
+    }
+
+    template<class vertex>
+    intTpair range_stats( vertex *V, intT s, intT e ) const
+    {
+        if( s == e )
+            return make_pair( (intT)0, (intT)0 );
+        return sequence::reduce<intT>( s, e,
+                                       VertexStats<vertex>( flags.get(), V ) );
+    }
+
+    bool chunk_active( intT c ) const
+    {
+        return chunks.get()[c];
+    }
+
+    // Partitions need not be aligned to chunks: the chunks shared with
+    // another partition are only ever set here, so that concurrent calls
+    // on the partitions next to [s,e) never lose an active chunk
+    void copy_range( const dense_frontier & src, intT s, intT e )
+    {
+        bool *d = flags.get();
+        const bool *sd = src.flags.get();
+        parallel_range( s, e, 4096, [&]( intT i ) { d[i] = sd[i]; } );
+        if( s == e )
+            return;
+        bool *c = chunks.get();
+        const bool *sc = src.chunks.get();
+        for( intT k=last_chunk( s ); k <= last_chunk( e-1 ); ++k )
+            if( k < first_chunk( s ) || ( k+1 ) << FRONTIER_LOG_CHUNK > e )
+            {
+                if( sc[k] && !c[k] )
+                    c[k] = true;
+            }
+            else
+                c[k] = sc[k];
+    }
+    void clear_range( intT s, intT e )
+    {
+        bool *d = flags.get();
+        std::fill( &d[s], &d[e], false );
+        if( first_chunk( s ) < last_chunk( e ) )
+            std::fill( &chunks.get()[first_chunk( s )],
+                       &chunks.get()[last_chunk( e )], false );
+    }
+
+    _seq<intT> pack( intT n ) const
+    {
+        return sequence::packIndex( flags.get(), n );
+    }
+};
+
+#endif // FRONTIER_BITMAP
+
+// Vertices per entry of the table locating the partition of a vertex in
+// frontier_counters
+#define FRONTIER_LOG_COUNT_BLOCK 12
+
+// Number of vertices activated by a traversal and the sum of their
+// out-degrees, counted by every worker on its own cache line. When
+// reset() is given a partitioner, they are also counted per partition,
+// so a traversal choosing its direction per partition (see
+// edgeMapPerPartition()) needs no pass over the frontier it reads. The
+// partition of a vertex is found from that of the first vertex of its
+// block of 2^FRONTIER_LOG_COUNT_BLOCK vertices.
+class frontier_counters
+{
+    struct worker
+    {
+        intT count, degrees;
+        intT *parts;    // per partition: activated vertices, out-degrees
+        char pad[64];   // keep workers on separate cache lines
+    };
+    worker *W;
+    int num_workers;
+    partitioner_view part;  // no partitions: totals only
+    intT parts_size;        // partitions allocated in every worker
+    std::vector<intT> block_part;   // partition of the first vertex of a block
+
+    intT partition_of( intT v ) const
+    {
+        intT p = block_part[v >> FRONTIER_LOG_COUNT_BLOCK];
+        while( part.start_of( p+1 ) <= v )
+            ++p;
+        return p;
+    }
+
+public:
+    frontier_counters() : W( 0 ), num_workers( 0 ), parts_size( 0 ) { }
+
+    // Call before counting. The buffers grow once and are reused.
+    void reset( partitioner_view p = partitioner_view() )
+    {
+        intT np = p.get_num_partitions();
+        if( num_workers < getWorkers() || parts_size < np )
+        {
+            for( int i=0; i < num_workers; ++i )
+                if( W[i].parts )
+                    delete [] W[i].parts;
+            if( W )
+                delete [] W;
+            num_workers = getWorkers();
+            parts_size = std::max( parts_size, np );
+            W = new worker [num_workers];
+            for( int i=0; i < num_workers; ++i )
+                W[i].parts = parts_size ? new intT [2*parts_size] : 0;
+        }
+        part = p;
+        if( np )
+        {
+            intT nb = ( ( p.get_num_elements() - 1 ) >> FRONTIER_LOG_COUNT_BLOCK ) + 1;
+            block_part.resize( nb );
+            intT q = 0;
+            for( intT b=0; b < nb; ++b )
+            {
+                while( p.start_of( q+1 ) <= ( b << FRONTIER_LOG_COUNT_BLOCK ) )
+                    ++q;
+                block_part[b] = q;
+            }
+        }
+        for( int i=0; i < num_workers; ++i )
+        {
+            W[i].count = W[i].degrees = 0;
+            if( np )
+                std::fill( W[i].parts, W[i].parts + 2*np, (intT)0 );
+        }
+    }
+    void add( intT v, intT degree )
+    {
+        worker &w = W[getWorkerNum()];
+        ++w.count;
+        w.degrees += degree;
+        if( part.get_num_partitions() )
+        {
+            intT p = partition_of( v );
+            ++w.parts[2*p];
+            w.parts[2*p+1] += degree;
+        }
+    }
+    intTpair total() const
+    {
+        intTpair t = make_pair( (intT)0, (intT)0 );
+        for( int i=0; i < num_workers; ++i )
+        {
+            t.first += W[i].count;
+            t.second += W[i].degrees;
+        }
+        return t;
+    }
+    // Activated vertices and their out-degrees in every partition of the
+    // partitioner given to reset()
+    void partition_totals( intTpair *out ) const
+    {
+        intT np = part.get_num_partitions();
+        for( intT p=0; p < np; ++p )
+        {
+            out[p] = make_pair( (intT)0, (intT)0 );
+            for( int i=0; i < num_workers; ++i )
+            {
+                out[p].first += W[i].parts[2*p];
+                out[p].second += W[i].parts[2*p+1];
+            }
+        }
+    }
+};
+
+// Write access to the output frontier of a dense traversal. Vertices that
+// become active are counted along with their out-degree, so the size of
+// the new frontier is known without another pass over it. With atomic,
+// several threads may activate vertices stored in the same word;
+// otherwise v must be owned by the calling thread (see set()).
+template<class vertex, bool atomic = true>
+class counting_frontier
+{
+    dense_frontier d;
+    vertex *V;
+    frontier_counters *stats;
+public:
+    counting_frontier( dense_frontier d_, vertex *V_, frontier_counters & s )
+        : d( d_ ), V( V_ ), stats( &s ) { }
+    void set( intT v )
+    {
+        if( atomic ? d.set_atomic( v ) : d.set( v ) )
+            stats->add( v, V[v].getOutDegree() );
+    }
+    // The same frontier, for a thread owning the vertices it activates
+    counting_frontier<vertex,false> owned() const
+    {
+        return counting_frontier<vertex,false>( d, V, *stats );
+    }
+};
+
+// Output of a traversal whose result is not needed, e.g. when all vertices
+// stay active (see edgeMapNoOutput()). Activations are dropped.
+struct no_frontier
+{
+    void set( intT v ) { }
+    no_frontier owned() const
+    {
+        return *this;
+    }
+};
+
+// Coarse summary of a dense frontier: prefix counts of the chunks of 64
+// vertices holding an active vertex. Tells in constant time whether a
+// range of vertices holds any active vertex, which lets the COO kernels
+// skip edge blocks whose sources are all idle. The frontier records its
+// active chunks as it is written (chunk_active()), so build() is a single
+// scan; the prefix counts are kept across builds.
+class active_summary
+{
+    intT *prefix;
+    intT num_chunks;
+    intT capacity;
+
+    struct chunk_flags
+    {
+        const dense_frontier & d;
+        chunk_flags( const dense_frontier & d_ ) : d( d_ ) { }
+        intT operator() ( intT c ) const
+        {
+            return d.chunk_active( c ) ? 1 : 0;
+        }
+    };
+public:
+    active_summary() : prefix( 0 ), num_chunks( 0 ), capacity( 0 ) { }
+
+    void build( const dense_frontier & d, intT n )
+    {
+        num_chunks = ( n + (1<<FRONTIER_LOG_CHUNK) - 1 ) >> FRONTIER_LOG_CHUNK;
+        if( capacity < num_chunks+1 )
+        {
+            if( prefix )
+                delete [] prefix;
+            capacity = num_chunks+1;
+            prefix = new intT [capacity];
+        }
+        prefix[num_chunks] = sequence::scan( prefix, (intT)0, num_chunks,
+                                             addF<intT>(), chunk_flags( d ),
+                                             (intT)0, false, false );
+    }
+    void del()
+    {
+        if( prefix )
+            delete [] prefix;
+        prefix = 0;
+        num_chunks = capacity = 0;
+    }
+    // Any active vertex among [lo,hi] (inclusive)
+    bool any( intT lo, intT hi ) const
+    {
+        return prefix[( hi >> FRONTIER_LOG_CHUNK ) + 1]
+            != prefix[lo >> FRONTIER_LOG_CHUNK];
+    }
+};
+
+// Output of the sparse edgeMap. Every worker appends the vertices it
+// activates to its own list of fixed-size chunks; gather() then
+// concatenates the lists once. Chunks are kept on per-worker free lists
+// and reused by later calls, so no memory is allocated in steady state
+// except for the returned array.
+#ifndef FRONTIER_CHUNK
+#define FRONTIER_CHUNK 2048
+#endif
+
+class frontier_buffers
+{
+    struct chunk
+    {
+        chunk *next;
+        intT n;
+        intT v[FRONTIER_CHUNK];
+    };
+    struct worker
+    {
+        chunk *head, *tail, *free;
+        intT count, degrees;
+        char pad[64];   // keep workers on separate cache lines
+    };
+    worker *W;
+    int num_workers;
+
+public:
+    frontier_buffers() : W( 0 ), num_workers( 0 ) { }
+
+    // Call before appending
+    void prepare()
+    {
+        if( num_workers < getWorkers() )
+        {
+            // Grows once, the first time a sparse edgeMap runs
+            worker *old = W;
+            int nw = getWorkers();
+            W = new worker [nw];
+            for( int i=0; i < nw; ++i )
+            {
+                W[i].head = W[i].tail = 0;
+                W[i].free = i < num_workers ? old[i].free : 0;
+                W[i].count = W[i].degrees = 0;
+            }
+            if( old )
+                delete [] old;
+            num_workers = nw;
+        }
+    }
+
+    // Not safe against spawns between reading the worker number and the
+    // store, which do not occur within a single call. The out-degree of v
+    // is summed up for the next direction decision.
+    void append( intT v, intT degree )
+    {
+        worker &w = W[getWorkerNum()];
+        chunk *c = w.tail;
+        if( !c || c->n == FRONTIER_CHUNK )
+        {
+            if( w.free )
+            {
+                c = w.free;
+                w.free = c->next;
+            }
+            else
+                c = new chunk;
+            c->n = 0;
+            c->next = 0;
+            if( w.tail )
+                w.tail->next = c;
+            else
+                w.head = c;
+            w.tail = c;
+        }
+        c->v[c->n++] = v;
+        ++w.count;
+        w.degrees += degree;
+    }
+
+    // Concatenate all appended vertices into a new array and recycle
+    // the chunks. Returns the number of vertices and the sum of the
+    // degrees passed to append().
+    intTpair gather( intT *& out )
+    {
+        intT *offsets = new intT [num_workers];
+        intT total = 0, degrees = 0;
+        for( int i=0; i < num_workers; ++i )
+        {
+            offsets[i] = total;
+            total += W[i].count;
+            degrees += W[i].degrees;
+        }
+        out = new intT [total];
+        parallel_range( 0, num_workers, 1, [&]( int i ) {
+            worker &w = W[i];
+            intT o = offsets[i];
+            for( chunk *c=w.head; c; c=c->next )
+            {
+                std::copy( &c->v[0], &c->v[c->n], &out[o] );
+                o += c->n;
+            }
+            if( w.tail )
+            {
+                w.tail->next = w.free;
+                w.free = w.head;
+            }
+            w.head = w.tail = 0;
+            w.count = w.degrees = 0;
+        } );
+        delete [] offsets;
+        return make_pair( total, degrees );
+    }
+};
+
+#endif // FRONTIER_H
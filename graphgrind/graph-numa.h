@@ -6,6 +6,9 @@
 #include <assert.h>
 #include "numa_page_check.h"
 #include "mm.h"
+#include "snapshot.h"
+#include "radix_sort.h"
+#include "stream_load.h"
 #include <unistd.h>
 #include <sched.h>
 #include <errno.h>
@@ -22,6 +25,43 @@
 #define EDGES_HILBERT 0
 #endif
 
+#ifndef FRONTIER_BITMAP
+#define FRONTIER_BITMAP 0
+#endif
+
+// Number of edges per block of a COO partition that share one source
+// range summary, used to skip blocks without active sources
+#ifndef COO_SOURCE_BLOCK
+#define COO_SOURCE_BLOCK 1024
+#endif
+
+// Copy the in-edges of every CSC partition to a block on its NUMA node,
+// after which the whole graph's in-edge array is no longer used
+#ifndef CSC_LOCAL
+#define CSC_LOCAL 1
+#endif
+
+// CSRPartitions for the dense push traversal (DENSE_FORWARD), built with
+// the COO partitions with source partitioning, where they replace the
+// CSC, and on demand with destination partitioning (see CSR_LAZY)
+#ifndef CSR_PUSH
+#define CSR_PUSH 1
+#endif
+
+// With destination partitioning, build the CSRPartitions in the first
+// DENSE_FORWARD traversal (1), so applications that never push neither
+// build nor keep them, or after partitioning (0)
+#ifndef CSR_LAZY
+#define CSR_LAZY 1
+#endif
+
+// Number of intE per edge in neighbor lists
+#ifndef WEIGHTED
+#define EDGE_WORDS 1
+#else
+#define EDGE_WORDS 2
+#endif
+
 template<typename It, typename Cmp>
 void mysort( It begin, It end, Cmp cmp )
 {
@@ -216,35 +256,37 @@ public:
     }
 };
 
-class Edge_Hilbert;
-class Edge
+// Edge of the COO partitions, with vertex IDs of type id_t. Vertex IDs
+// need not be as wide as intT, which also counts edges and holds edge
+// offsets and so is 64 bits with LONG.
+template<class id_t>
+class EdgeT
 {
 private:
-    intT src, dst;
+    id_t src, dst;
 #ifdef WEIGHTED
     intE weight;
 #endif
 
 public:
-    Edge() { }
+    EdgeT() { }
 #ifdef WEIGHTED
-    Edge( intT s, intT d, intE w ) : src( s ), dst( d ), weight( w ) { }
+    EdgeT( intT s, intT d, intE w ) : src( s ), dst( d ), weight( w ) { }
 #else
-    Edge( intT s, intT d, intE w ) : src( s ), dst( d ) { }
-    Edge( intT s, intT d ) : src( s ), dst( d ) { }
+    EdgeT( intT s, intT d, intE w ) : src( s ), dst( d ) { }
+    EdgeT( intT s, intT d ) : src( s ), dst( d ) { }
 #endif
-    Edge( const Edge & e ) : src( e.src ), dst( e.dst )
+    EdgeT( const EdgeT & e ) : src( e.src ), dst( e.dst )
 #ifdef WEIGHTED
         , weight( e.weight )
 #endif
     { }
-        Edge( const Edge_Hilbert & e );
 
-    intE getSource() const
+    id_t getSource() const
     {
         return src;
     }
-    intE getDestination() const
+    id_t getDestination() const
     {
         return dst;
     }
@@ -265,39 +307,9 @@ public:
       swap(src,dst);
     }
 };
-class Edge_Hilbert : public Edge
-{
-private:
-    intT e2d;
-
-public:
-    Edge_Hilbert() { }
-#ifdef WEIGHTED
-    Edge_Hilbert( intT s, intT d, intE w ) : Edge(s,d,w), e2d(0) {}
-#else
-    Edge_Hilbert( intT s, intT d, intE w ) : Edge(s,d), e2d(0) { }
-    Edge_Hilbert( intT s, intT d ) : Edge(s,d), e2d(0) { }
-#endif
-    Edge_Hilbert( const Edge & e ) : Edge(e), e2d(0) {}
-	
-    
-	intT getE2d() const
-	{
-		return e2d;
-	}
-	void setE2d(intT value)
-	{
-		e2d = value;
-	}
-
-};
-
-Edge::Edge( const Edge_Hilbert & e ) : src( e.src ), dst( e.dst )
-#ifdef WEIGHTED
-        , weight( e.weight )
-#endif
-    { }
-
+// Vertex IDs are stored as intE, as in the neighbor lists: 32 bits unless
+// EDGELONG, whatever the width of intT
+typedef EdgeT<intE> Edge;
 template<typename T>
 typename std::make_unsigned<T>::type roundUpPow2( T n_u )
 {
@@ -324,94 +336,148 @@ public:
    }
 };
 
-class CSRSort
+// Order of the edges of COO partitions: along a Hilbert curve over the
+// adjacency matrix with EDGES_HILBERT, else by source, then destination.
+// key() gives the position of an edge in the order and edge() the edge at
+// a position, so edges are sorted by sorting their keys.
+//
+// The Hilbert curve (https://en.wikipedia.org/wiki/Hilbert_curve, xy2d and
+// d2xy) is followed as a state machine: the state says whether x and y are
+// swapped (bit 0) and inverted (bit 1) in the current quadrant. Tables
+// map a state and 4 levels of x and y to 8 bits of the key and the next
+// state, and back, so a key costs one lookup per 4 levels.
+class EdgeOrder
 {
-  intT n;
-public:
-   CSRSort ( intT n_) : n(n_){ }
-   bool operator () ( const Edge & i, const Edge & j ) 
-   {
-           return i.getSource()<j.getSource();
-   }
-};
-//second sort for csr
-class CSRDestSort
-{
-  intT n;
-public:
-   CSRDestSort ( intT n_) : n(n_){ }
-   bool operator () ( const Edge & i, const Edge & j ) 
-   {
-           if (i.getSource()==j.getSource())
-             return i.getDestination()<j.getDestination();
-           else
-             return i.getSource()<j.getSource();
-   }
-};
+    intT n;     // side of the matrix, a power of 2
+    int logn;
 
-// Source code based on https://en.wikipedia.org/wiki/Hilbert_curve
-class HilbertEdgeSort
-{
-    intT n;
+#if EDGES_HILBERT
+    // One level: the quadrant of bits (bx,by) in state st, returns the
+    // next state
+    static int encode_level( int st, int bx, int by, int & digit )
+    {
+        int rx = ( ( st & 1 ) ? by : bx ) ^ ( st >> 1 );
+        int ry = ( ( st & 1 ) ? bx : by ) ^ ( st >> 1 );
+        digit = ( 3 * rx ) ^ ry;
+        return ry ? st : st ^ 1 ^ ( rx << 1 );
+    }
+    static int decode_level( int st, int digit, int & bx, int & by )
+    {
+        int rx = digit >> 1;
+        int ry = ( digit ^ rx ) & 1;
+        int ex = rx ^ ( st >> 1 ), ey = ry ^ ( st >> 1 );
+        bx = ( st & 1 ) ? ey : ex;
+        by = ( st & 1 ) ? ex : ey;
+        return ry ? st : st ^ 1 ^ ( rx << 1 );
+    }
+    struct tables
+    {
+        // [state][x bits << 4 | y bits] = key bits | next state << 8
+        uint16_t enc[4][256];
+        // [state][key bits] = x bits << 4 | y bits | next state << 8
+        uint16_t dec[4][256];
+        tables()
+        {
+            for( int st=0; st < 4; ++st )
+                for( int i=0; i < 256; ++i )
+                {
+                    int s = st, d = 0, x = 0, y = 0;
+                    for( int l=3; l >= 0; --l )
+                    {
+                        int digit;
+                        s = encode_level( s, ( i >> ( 4 + l ) ) & 1,
+                                          ( i >> l ) & 1, digit );
+                        d = ( d << 2 ) | digit;
+                    }
+                    enc[st][i] = d | ( s << 8 );
+                    s = st;
+                    for( int l=3; l >= 0; --l )
+                    {
+                        int bx, by;
+                        s = decode_level( s, ( i >> ( 2 * l ) ) & 3, bx, by );
+                        x = ( x << 1 ) | bx;
+                        y = ( y << 1 ) | by;
+                    }
+                    dec[st][i] = ( x << 4 ) | y | ( s << 8 );
+                }
+        }
+    };
+    static const tables & get_tables()
+    {
+        static tables t;
+        return t;
+    }
+    const tables & T;
+#endif
 
 public:
-    HilbertEdgeSort( intT n_ ) : n( roundUpPow2(n_) ) { }
+    EdgeOrder( intT num_vertices )
+        : n( roundUpPow2( num_vertices ) ),
+          logn( radix_sort::bits_for( n ) - 1 )
+#if EDGES_HILBERT
+        , T( get_tables() )
+#endif
+    { }
 
-    bool operator () ( const Edge_Hilbert & l, const Edge_Hilbert & r ) const
+    // Number of bits of the keys
+    int bits() const
     {
-        return e2d( l ) < e2d( r );
+        return 2 * logn;
     }
 
-private:
-    intT e2d( const Edge_Hilbert & e ) const
-    {
-        if(e.getE2d() == 0)
-		{
-			const_cast<Edge_Hilbert *>(&e)->setE2d(xy2d(e.getSource(), e.getDestination()));
-		}
-        return e.getE2d();				  
-    }
-    //convert (x,y) to d
-    intT xy2d( intT x, intT y ) const
+#if EDGES_HILBERT
+    uint64_t key( intT x, intT y ) const
     {
-        intT rx, ry, s, d=0;
-        for (s=n/2; s>0; s/=2)
+        uint64_t d = 0;
+        int st = 0, l = logn;
+        for( ; l % 4; )
+        {
+            int digit;
+            --l;
+            st = encode_level( st, ( x >> l ) & 1, ( y >> l ) & 1, digit );
+            d = ( d << 2 ) | digit;
+        }
+        for( ; l > 0; )
         {
-            rx = (x & s) > 0;
-            ry = (y & s) > 0;
-            d += s * s * ((3 * rx) ^ ry);
-            rot(s, &x, &y, rx, ry);
+            l -= 4;
+            uint16_t e = T.enc[st][( ( ( x >> l ) & 15 ) << 4 ) | ( ( y >> l ) & 15 )];
+            d = ( d << 8 ) | ( e & 255 );
+            st = e >> 8;
         }
         return d;
     }
-
-    //convert d to (x,y)
-    void d2xy(intT d, intT *x, intT *y) const
+    void edge( uint64_t d, intT & x, intT & y ) const
     {
-        intT rx, ry, s, t=d;
-        *x = *y = 0;
-        for (s=1; s<n; s*=2)
+        x = y = 0;
+        int st = 0, l = logn;
+        for( ; l % 4; )
         {
-            rx = 1 & (t/2);
-            ry = 1 & (t ^ rx);
-            rot(s, x, y, rx, ry);
-            *x += s * rx;
-            *y += s * ry;
-            t /= 4;
+            int bx, by;
+            --l;
+            st = decode_level( st, ( d >> ( 2 * l ) ) & 3, bx, by );
+            x = ( x << 1 ) | bx;
+            y = ( y << 1 ) | by;
         }
-    }
-    static void rot( intT n, intT *x, intT *y, intT rx, intT ry )
-    {
-        if (ry == 0)
+        for( ; l > 0; )
         {
-            if (rx == 1)
-            {
-                *x = n-1 - *x;
-                *y = n-1 - *y;
-            }
-            std::swap( *x, *y );
+            l -= 4;
+            uint16_t e = T.dec[st][( d >> ( 2 * l ) ) & 255];
+            x = ( x << 4 ) | ( ( e >> 4 ) & 15 );
+            y = ( y << 4 ) | ( e & 15 );
+            st = e >> 8;
         }
     }
+#else
+    uint64_t key( intT x, intT y ) const
+    {
+        return ( (uint64_t)x << logn ) | y;
+    }
+    void edge( uint64_t d, intT & x, intT & y ) const
+    {
+        x = d >> logn;
+        y = d & ( n - 1 );
+    }
+#endif
 };
 
 template<class Edge>
@@ -419,24 +485,24 @@ class EdgeList
 {
 private:
     mmap_ptr<Edge> edges;
-    intE num_edges;
+    // lowest and highest source of each block of COO_SOURCE_BLOCK edges
+    mmap_ptr< pair<intT,intT> > block_sources;
+    intT num_edges;
     intT num_vertices;
     int numanode;
 public:
     EdgeList() {}
-    EdgeList(intE m, intT n, int pp) : num_edges(m), num_vertices(n), numanode(pp)
+    EdgeList(intT m, intT n, int pp) : num_edges(m), num_vertices(n), numanode(pp)
     {
 	  edges.local_allocate(num_edges,numanode);
     }
     void del()
     {
           edges.del();
+          block_sources.del();
     }
     typedef Edge * iterator;
     typedef const Edge * const_iterator;
-    
-    typedef Edge_Hilbert * hil_iterator;
-    typedef const Edge_Hilbert * const_hil_iterator;
 
     iterator begin()
     {
@@ -479,18 +545,306 @@ public:
     {
         return edges[i];
     }
-    void hilbert_sort()
+    // Set the edges from their keys in EdgeOrder: fill( keys, weights )
+    // stores the key and, if WEIGHTED, the weight of every edge, in any
+    // order. The keys are radix sorted and decoded into the list, so the
+    // edges are written once, in order, on the node of the list.
+    template<class Fill>
+    void fill_sorted( Fill fill )
+    {
+        EdgeOrder order( num_vertices );
+        mmap_ptr<uint64_t> keys, tkeys;
+        keys.local_allocate( num_edges, numanode );
+        tkeys.local_allocate( num_edges, numanode );
+        mmap_ptr<intE> weights, tweights;
+#ifdef WEIGHTED
+        weights.local_allocate( num_edges, numanode );
+        tweights.local_allocate( num_edges, numanode );
+#endif
+        fill( keys.get(), weights.get() );
+        radix_sort::sort( num_edges, order.bits(), keys.get(), tkeys.get(),
+                          weights.get(), tweights.get() );
+        tkeys.del();
+        tweights.del();
+        const uint64_t *k = keys.get();
+        parallel_range( (intT)0, num_edges, 2048, [&]( intT i ) {
+            intT s, d;
+            order.edge( k[i], s, d );
+#ifndef WEIGHTED
+            edges[i] = Edge( s, d );
+#else
+            const intE *w = weights.get();
+            edges[i] = Edge( s, d, w[i] );
+#endif
+        } );
+        keys.del();
+        weights.del();
+    }
+    // Sort the edges in EdgeOrder
+    void sort()
+    {
+        const Edge *e = edges.get();
+        EdgeOrder order( num_vertices );
+        fill_sorted( [&]( uint64_t * keys, intE * weights ) {
+                parallel_range( (intT)0, num_edges, 4096, [&]( intT i ) {
+                    keys[i] = order.key( e[i].getSource(), e[i].getDestination() );
+#ifdef WEIGHTED
+                    weights[i] = e[i].getWeight();
+#endif
+                } );
+            } );
+    }
+
+    intT get_num_blocks() const
     {
-		mmap_ptr<Edge_Hilbert> hilbert_edges;
-		hilbert_edges.local_allocate(num_edges,numanode);
-		std::copy( begin(), end(), hilbert_edges.get() );													 
-		mysort(&hilbert_edges[0], &hilbert_edges[num_edges], HilbertEdgeSort(num_edges));
-		std::copy( &hilbert_edges[0], &hilbert_edges[num_edges], edges.get() );														   
-		hilbert_edges.del();
+        return (num_edges + COO_SOURCE_BLOCK - 1) / COO_SOURCE_BLOCK;
     }
-    void CSR_sort()
+    const pair<intT,intT> & get_block_sources( intT b ) const
     {
-	mysort(&edges[0], &edges[num_edges], CSRDestSort(num_edges));
+        return block_sources[b];
+    }
+    // Record the source range of every block. Call after sorting.
+    void summarize_sources()
+    {
+        intT nb = get_num_blocks();
+        block_sources.local_allocate(nb,numanode);
+        for( intT b=0; b < nb; ++b )
+        {
+            intT s = b * COO_SOURCE_BLOCK;
+            intT e = std::min( s + COO_SOURCE_BLOCK, num_edges );
+            intT lo = edges[s].getSource(), hi = lo;
+            for( intT i=s+1; i < e; ++i )
+            {
+                lo = std::min( lo, (intT)edges[i].getSource() );
+                hi = std::max( hi, (intT)edges[i].getSource() );
+            }
+            block_sources[b] = make_pair( lo, hi );
+        }
+    }
+
+    // Snapshot of a sorted and summarized partition, read back by
+    // partitioned_graph::load_snapshot()
+    void save( snapshot::writer & w ) const
+    {
+        w.put( (uint64_t)num_edges );
+        w.array( edges.get(), num_edges );
+        w.array( block_sources.get(), get_num_blocks() );
+    }
+    void load( const Edge * e, const pair<intT,intT> * blocks )
+    {
+        std::copy( e, e + num_edges, edges.get() );
+        intT nb = get_num_blocks();
+        block_sources.local_allocate(nb,numanode);
+        std::copy( blocks, blocks + nb, block_sources.get() );
+    }
+};
+
+// Out-edges of one COO partition grouped by source (compressed sparse
+// rows), on the NUMA node of the partition, for the dense push traversal
+// (DENSE_FORWARD). With source partitioning it holds the complete
+// out-lists of the partition's vertices, in adjacency order. With
+// destination partitioning it holds, for every source, the out-edges
+// ending in the partition, so a single task can push them without
+// atomics.
+class CSRPartition
+{
+    mmap_ptr<intE> sources;     // sources with edges, ascending
+    mmap_ptr<intT> offsets;     // edges of sources[i]: [offsets[i],offsets[i+1])
+    mmap_ptr<intE> edges;       // destination (and weight) of every edge
+    intT num_sources;
+    bool local_dst;
+
+    void allocate( intT ns, intT ne, int node )
+    {
+        num_sources = ns;
+        sources.local_allocate( ns, node );
+        offsets.local_allocate( ns+1, node );
+        edges.local_allocate( ne*EDGE_WORDS, node );
+    }
+public:
+    CSRPartition() : num_sources( 0 ), local_dst( false ) { }
+
+    // Out-edges of the vertices [rangeLow,rangeHi)
+    template<class vertex>
+    void build_by_source( vertex * V, intT rangeLow, intT rangeHi, int node )
+    {
+        intT ns = 0;
+        intT ne = 0;
+        for( intT i=rangeLow; i < rangeHi; ++i )
+            if( V[i].getOutDegree() != 0 )
+            {
+                ++ns;
+                ne += V[i].getOutDegree();
+            }
+        allocate( ns, ne, node );
+        local_dst = false;
+        intT k = 0;
+        intT e = 0;
+        for( intT i=rangeLow; i < rangeHi; ++i )
+        {
+            intT d = V[i].getOutDegree();
+            if( d == 0 )
+                continue;
+            sources[k] = i;
+            offsets[k++] = e;
+            std::copy( V[i].getOutNeighborPtr(),
+                       V[i].getOutNeighborPtr() + d*EDGE_WORDS, &edges[e*EDGE_WORDS] );
+            e += d;
+        }
+        offsets[k] = e;
+    }
+    // Out-edges of all sources to the vertices [rangeLow,rangeHi), from
+    // their in-edges, of a graph with n vertices. The edges are keyed by
+    // source, then destination, and radix sorted as in
+    // EdgeList::fill_sorted(), so the work is linear in the edges of the
+    // partition and not in n.
+    template<class vertex>
+    void build_by_destination( vertex * V, intT n, intT rangeLow, intT rangeHi, int node )
+    {
+        intT nv = rangeHi - rangeLow;
+        int dbits = radix_sort::bits_for( nv );
+        intT *start = new intT [nv+1];
+        intT ne = 0;
+        for( intT i=rangeLow; i < rangeHi; ++i )
+        {
+            start[i-rangeLow] = ne;
+            ne += V[i].getInDegree();
+        }
+        start[nv] = ne;
+        mmap_ptr<uint64_t> keys, tkeys;
+        keys.local_allocate( ne, node );
+        tkeys.local_allocate( ne, node );
+        mmap_ptr<intE> weights, tweights;
+#ifdef WEIGHTED
+        weights.local_allocate( ne, node );
+        tweights.local_allocate( ne, node );
+#endif
+        parallel_range( rangeLow, rangeHi, 256, [&]( intT i ) {
+            uint64_t *k = &keys[start[i-rangeLow]];
+            intT d = V[i].getInDegree();
+            for( intT j=0; j < d; ++j )
+            {
+                k[j] = ( (uint64_t)V[i].getInNeighbor( j ) << dbits ) | ( i - rangeLow );
+#ifdef WEIGHTED
+                weights[start[i-rangeLow]+j] = V[i].getInWeight( j );
+#endif
+            }
+        } );
+        delete [] start;
+        radix_sort::sort( ne, dbits + radix_sort::bits_for( n ), keys.get(), tkeys.get(),
+                          weights.get(), tweights.get() );
+        tkeys.del();
+        tweights.del();
+        const uint64_t *k = keys.get();
+        intT ns = 0;
+        for( intT j=0; j < ne; ++j )
+            if( j == 0 || ( k[j] >> dbits ) != ( k[j-1] >> dbits ) )
+                ++ns;
+        allocate( ns, ne, node );
+        local_dst = true;
+        intT p = 0;
+        for( intT j=0; j < ne; ++j )
+        {
+            if( j == 0 || ( k[j] >> dbits ) != ( k[j-1] >> dbits ) )
+            {
+                sources[p] = k[j] >> dbits;
+                offsets[p++] = j;
+            }
+            edges[j*EDGE_WORDS] = rangeLow + ( k[j] & ( ( (uint64_t)1 << dbits ) - 1 ) );
+#ifdef WEIGHTED
+            edges[j*EDGE_WORDS+1] = weights[j];
+#endif
+        }
+        offsets[p] = ne;
+        keys.del();
+        weights.del();
+    }
+    void del()
+    {
+        sources.del();
+        offsets.del();
+        edges.del();
+        num_sources = 0;
+    }
+
+    // Snapshot, read back by partitioned_graph::load_snapshot()
+    void save( snapshot::writer & w ) const
+    {
+        intT ne = offsets[num_sources];
+        w.put( (uint64_t)num_sources );
+        w.put( (uint64_t)ne );
+        w.put( (uint64_t)local_dst );
+        w.array( sources.get(), num_sources );
+        w.array( offsets.get(), num_sources+1 );
+        w.array( edges.get(), ne*EDGE_WORDS );
+    }
+    void load( intT ns, intT ne, bool local, const intE * s, const intT * o,
+               const intE * e, int node )
+    {
+        allocate( ns, ne, node );
+        local_dst = local;
+        std::copy( s, s + ns, sources.get() );
+        std::copy( o, o + ns+1, offsets.get() );
+        std::copy( e, e + ne*EDGE_WORDS, edges.get() );
+    }
+
+    bool built() const
+    {
+        return offsets;
+    }
+    intT get_num_sources() const
+    {
+        return num_sources;
+    }
+    // All destinations are vertices of the partition
+    bool local_destinations() const
+    {
+        return local_dst;
+    }
+    intT source( intT i ) const
+    {
+        return sources[i];
+    }
+    intT begin( intT i ) const
+    {
+        return offsets[i];
+    }
+    intT end( intT i ) const
+    {
+        return offsets[i+1];
+    }
+    intE destination( intT j ) const
+    {
+        return edges[j*EDGE_WORDS];
+    }
+#ifndef WEIGHTED
+    intE weight( intT j ) const
+    {
+        return 1;
+    }
+#else
+    intE weight( intT j ) const
+    {
+        return edges[j*EDGE_WORDS+1];
+    }
+#endif
+};
+
+// Read-only mapping of an input file whose pages are used in place as an
+// edge array (see readGraphFromGalois())
+struct file_map
+{
+    void * addr;
+    size_t len;
+
+    file_map() : addr(0), len(0) {}
+    file_map(void * a, size_t l) : addr(a), len(l) {}
+    void del()
+    {
+        if( addr )
+            munmap( addr, len );
+        addr = 0;
+        len = 0;
     }
 };
 
@@ -507,17 +861,24 @@ public:
     mmap_ptr<intT> flags;
     mmap_ptr<intE> allocatedInplace;
     mmap_ptr<intE> inEdges;
+    // Input files mapped in place of allocatedInplace and inEdges
+    file_map outMap, inMap;
+    // Reader of the mapped files, while they are streamed (-stream)
+    stream_load::reader *stream;
     bool transposed;
     bool isSymmetric;
 
-    wholeGraph() {}
-    wholeGraph(intT nn, intT mm, bool issym)
-        : n(nn), m(mm), isSymmetric(issym),
+    wholeGraph() : stream(0) {}
+    // Without alloc_edges, the loader provides the edge arrays
+    wholeGraph(intT nn, intT mm, bool issym, bool alloc_edges=true)
+        : n(nn), m(mm), stream(0), isSymmetric(issym),
           transposed(false)
     {
 
 //NUMA_AWARE and Ligra_normal without partition
            V.Interleave_allocate(n);
+           if(!alloc_edges)
+               return;
 #ifndef WEIGHTED
 	   allocatedInplace.Interleave_allocate(m);
 #else//WEIGHTED
@@ -535,10 +896,81 @@ public:
 
     void del()
     {
+        wait_for_all_edges();
+        delete stream;
+        stream = 0;
         flags.del();
         allocatedInplace.del();
         V.del();
         inEdges.del();
+        outMap.del();
+        inMap.del();
+    }
+    // With a streaming load, wait until the in- or out-edges of the
+    // vertices [lo,hi) have been read
+    void wait_for_edges( intT lo, intT hi, bool in )
+    {
+        if( !stream || lo >= hi )
+            return;
+        vertex & v = V[hi-1];
+        if( in )
+            stream->wait( v.getInNeighborPtr() + v.getInDegree()*EDGE_WORDS );
+        else
+            stream->wait( v.getOutNeighborPtr() + v.getOutDegree()*EDGE_WORDS );
+    }
+    void wait_for_all_edges()
+    {
+        if( stream )
+            stream->wait_all();
+    }
+    // Release all edge arrays, keeping the vertices and their degrees,
+    // once the COO partitions are the only representation used
+    // (RESIDENT_COO)
+    void del_edges()
+    {
+        wait_for_all_edges();
+        allocatedInplace.del();
+        inEdges.del();
+        outMap.del();
+        inMap.del();
+    }
+    // Release the in-edge array once nothing points into it any more,
+    // i.e. after partitioned_graph has moved the in-edges of all vertices
+    // to its CSC partitions (CSC_LOCAL). For symmetric graphs these are
+    // the only neighbor lists.
+    void del_in_edges()
+    {
+        wait_for_all_edges();
+        if( isSymmetric )
+        {
+            allocatedInplace.del();
+            outMap.del();
+        }
+        else
+        {
+            inEdges.del();
+            inMap.del();
+        }
+    }
+
+    // Hash of the out-degrees and out-edges (with weights) of all
+    // vertices, identifying the graph in snapshots
+    uint64_t content_hash() const
+    {
+        vertex *VV = V.get();
+        uint64_t degrees = snapshot::hash( n, [&]( intT i ) {
+                return (uint64_t)VV[i].getOutDegree(); } );
+        uint64_t *vh = new uint64_t [n];
+        parallel_range( (intT)0, n, 1024, [&]( intT i ) {
+            const intE *e = VV[i].getOutNeighborPtr();
+            uint64_t h = 0;
+            for( intT j=0; j < VV[i].getOutDegree()*EDGE_WORDS; ++j )
+                h = snapshot::mix( h, (uint64_t)e[j] );
+            vh[i] = h;
+        } );
+        uint64_t edges = snapshot::hash( n, [&]( intT i ) { return vh[i]; } );
+        delete [] vh;
+        return snapshot::mix( degrees, edges );
     }
 
 //    void reorder_vertices( intT * __restrict reorder );
@@ -548,8 +980,9 @@ public:
     {
         if(!isSymmetric)
         {
-            parallel_for(intT i=0; i<n; i++)
-		V[i].flipEdges();
+            parallel_range( (intT)0, n, 4096, [&]( intT i ) {
+                    V[i].flipEdges();
+                } );
             transposed = !transposed;
         }
     }
@@ -566,7 +999,12 @@ public:
     intT CSCVn;
     mmap_ptr<vertex> V;  //mmap
     mmap_ptr< pair<intT,vertex> > CSCV;
+    // CSCOffsets[i] = number of in-edges of CSCV[0..i-1], for splitting
+    // ranges of CSCV into chunks with equal numbers of edges
+    mmap_ptr<intT> CSCOffsets;
     partitioner csc;
+    // In-edges of the vertices of each CSC partition (see localize_in_edges)
+    mmap_ptr<intE> * CSCEdges;
     bool transposed;
     bool isSymmetric;
 
@@ -574,12 +1012,13 @@ public:
 //remove the empty vertices,
 //restruct the vertext set,
 //CSC for backwark and CSR for forward;
-    graph() {}
+    graph() : CSCEdges(0) {}
     graph(intT nn, intT mm, intT cscn, int coo, bool issym)
         : n(nn), m(mm), isSymmetric(issym),
           transposed(false),
           CSCVn(cscn),
-          csc(coo,cscn)
+          csc(coo,cscn),
+          CSCEdges(0)
     {
 //NUMA_AWARE and Ligra_normal without partition
     }
@@ -587,9 +1026,59 @@ public:
     void del()
     {
         CSCV.del(); 
+        CSCOffsets.del();
+        if( CSCEdges )
+        {
+            for( int p=0; p < csc.get_num_partitions(); ++p )
+                CSCEdges[p].del();
+            delete [] CSCEdges;
+            CSCEdges = 0;
+        }
     //    V.del();
     }
 
+    // Move CSCV and the in-edges of its vertices to the NUMA nodes of
+    // their CSC partitions: CSCV is re-allocated along csc, the in-edges
+    // of partition p are copied to one block on its node and the vertices
+    // of CSCV and of WV (the whole graph) are pointed at the copies. Call
+    // once csc and CSCOffsets are computed and before any transpose().
+    void localize_in_edges(vertex * WV)
+    {
+        mmap_ptr< pair<intT,vertex> > localV;
+        localV.part_allocate(csc);
+        int np = csc.get_num_partitions();
+        CSCEdges = new mmap_ptr<intE> [np];
+        map_partitionL( csc, [&]( int p ) {
+                intT s = csc.start_of(p), e = csc.start_of(p+1);
+                CSCEdges[p].local_allocate( (CSCOffsets[e]-CSCOffsets[s])*EDGE_WORDS,
+                                            csc.node_of(p) );
+                intE *edges = CSCEdges[p].get();
+                for( intT i=s; i < e; ++i )
+                {
+                    vertex v = CSCV[i].second;
+                    intT d = v.getInDegree();
+                    std::copy( v.getInNeighborPtr(),
+                               v.getInNeighborPtr() + d*EDGE_WORDS, edges );
+                    v.setInNeighbors( edges );
+                    WV[CSCV[i].first].setInNeighbors( edges );
+                    localV[i] = make_pair( CSCV[i].first, v );
+                    edges += d*EDGE_WORDS;
+                }
+            } );
+        CSCV.del();
+        CSCV = localV;
+    }
+
+    void compute_csc_offsets()
+    {
+        if( !CSCOffsets )
+            CSCOffsets.Interleave_allocate(CSCVn+1);
+        parallel_range( (intT)0, CSCVn, 4096, [&]( intT i ) {
+                CSCOffsets[i] = CSCV[i].second.getInDegree();
+            } );
+        CSCOffsets[CSCVn] = sequence::plusScan(CSCOffsets.get(), CSCOffsets.get(), CSCVn);
+    }
+
   //  void reorder_vertices( intT * __restrict reorder );
     const partitioner & get_csc_partitioner() const
     {
@@ -601,16 +1090,58 @@ public:
         {
             if(CSCV)
             {
-                parallel_for (intT i=0; i<CSCVn; i++)
-		    CSCV[i].second.flipEdges();
+                parallel_range( (intT)0, CSCVn, 4096, [&]( intT i ) {
+                        CSCV[i].second.flipEdges();
+                    } );
+                compute_csc_offsets();
             }
-            parallel_for(intT i=0; i<n; i++)
-		V[i].flipEdges();
+            parallel_range( (intT)0, n, 4096, [&]( intT i ) {
+                    V[i].flipEdges();
+                } );
             transposed = !transposed;
         }
     }
 
 };
+
+//Non-owning, trivially copyable view of a graph for the edgeMap kernels.
+//Copying it copies pointers only; the graph keeps ownership and must
+//outlive the view.
+template <class vertex>
+class graph_view
+{
+public:
+    intT n;
+    intT m;
+    intT CSCVn;
+    vertex * V;
+    pair<intT,vertex> * CSCV;
+    const intT * CSCOffsets;
+    partitioner_view csc;
+    bool transposed;
+    bool isSymmetric;
+
+    graph_view( graph<vertex> & G )
+        : n( G.n ), m( G.m ), CSCVn( G.CSCVn ), V( G.V.get() ),
+          CSCV( G.CSCV.get() ), CSCOffsets( G.CSCOffsets.get() ),
+          csc( G.csc ), transposed( G.transposed ),
+          isSymmetric( G.isSymmetric ) { }
+
+    partitioner_view get_csc_partitioner() const
+    {
+        return csc;
+    }
+};
+
+template <class vertex>
+class partitioned_graph_view;
+
+//Representations of the graph kept after partitioning (run option -mem):
+//everything, the CSC with the neighbor lists of the whole graph for the
+//sparse traversals, or the COO partitions only. The others are released
+//by partitioned_graph::release() and edgeMap uses what is left.
+enum resident_t { RESIDENT_ALL, RESIDENT_CSC, RESIDENT_COO };
+
 //Graph partitioning, contain partitioned graph,
 //partitioner value
 //Select there partitioning method,
@@ -626,6 +1157,7 @@ public:
 template <class vertex>
 class partitioned_graph
 {
+    friend class partitioned_graph_view<vertex>;
 public:
     typedef vertex vertex_type;
 
@@ -634,64 +1166,96 @@ public:
     bool source;
     bool part_ver;
     bool part_relabel;
+    resident_t resident;
 private:
     // All variables should be private
     EdgeList<Edge> * localEdgeList;
+    // COO partitions of the other direction, built by the first
+    // transpose() and swapped with localEdgeList by every transpose()
+    EdgeList<Edge> * reverseEdgeList;
+    CSRPartition * localCSR;
     graph<vertex> CSCGraph;
 public:
+    // With snapshot_file, the partitions are read from that snapshot if it
+    // matches GA and the options, else built and written to it
     partitioned_graph( wholeGraph<vertex> & GA, 
-                       int coo_part, bool partition_source, bool partition_vertex, bool partition_relabel)
+                       int coo_part, bool partition_source, bool partition_vertex, bool partition_relabel,
+                       const char * snapshot_file = 0 )
         : m(GA.m),n(GA.n),
           coo_partition(coo_part,GA.n), 
-          source(partition_source), part_ver(partition_vertex),part_relabel(partition_relabel)
+          source(partition_source), part_ver(partition_vertex),part_relabel(partition_relabel),
+          resident(RESIDENT_ALL)
     {
         //cerr<<"m="<<m<<"n="<<n<<endl;
-        const int coo_perNode = coo_partition.get_num_per_node_partitions();
         localEdgeList = new EdgeList<Edge>[coo_part];
-        if(partition_vertex)
-             partitionByVertex( GA, coo_part, coo_partition.as_array(), partition_relabel);
-        else
-             partitionByDegree( GA, coo_part, coo_partition.as_array(), partition_source,partition_relabel );
-        coo_partition.compute_starts();
-#if CPU_PARTITION
-        coo_partition.compute_vertexstarts();
+        reverseEdgeList = 0;
+        localCSR = new CSRPartition[coo_part];
+        std::vector<uint64_t> key;
+        if( snapshot_file )
+        {
+            GA.wait_for_all_edges();
+            key = snapshot_key( GA );
+        }
+        if( !snapshot_file || !load_snapshot( GA, snapshot_file, key ) )
+        {
+            build( GA, coo_part, partition_source, partition_vertex, partition_relabel );
+            if( snapshot_file )
+                save_snapshot( snapshot_file, key );
+        }
+#if CSR_PUSH && !CSR_LAZY
+        // The destination partitioned CSRs are neither built by build()
+        // nor kept in snapshots; build them before the timed rounds
+        partitioned_graph_view<vertex>( *this ).build_csr();
 #endif
-          timer par;
-          par.start(); 
-          if(!partition_vertex){
-            cerr<<"edge partitioning...."<<endl;
-	    map_partitionL( coo_partition, [&]( int p ) {
-		    int i = p / coo_partition.get_num_per_node_partitions();
-                    if( partition_source)
-                        localEdgeList[p] = COOPartitionBySour( GA, coo_partition.start_of(p), coo_partition.start_of(p+1),i);
-                    else   //Partition Function for ICS and ICPP paper 
-                        localEdgeList[p] = COOPartitionByDest( GA, coo_partition.start_of(p), coo_partition.start_of(p+1),i);
-#if EDGES_HILBERT
-                        localEdgeList[p].hilbert_sort();
-#else
-                        localEdgeList[p].CSR_sort();
+#if CSC_LOCAL
+        CSCGraph.localize_in_edges(GA.V.get());
 #endif
-                } );
-	  }
-         cerr<<"COO: "<<par.stop()<<endl;
-        //cerr<<"CSC Chunk"<<endl;
-        CSCGraph = PartitionByDest(GA,0,GA.m,coo_part);
-        if(partition_vertex)
-            cscpartitionByVertex(CSCGraph,coo_part,CSCGraph.csc.as_array(),partition_relabel);
-        else
-            cscpartitionByDegree(CSCGraph,coo_part,CSCGraph.csc.as_array(),partition_source, partition_relabel);
-        CSCGraph.csc.compute_starts(); 
 
     }
     void del()
     {
         
         for( int p=0; p < coo_partition.get_num_partitions(); ++p )
+        {
 	    localEdgeList[p].del();
+            if( reverseEdgeList )
+                reverseEdgeList[p].del();
+            localCSR[p].del();
+        }
 
         delete [] localEdgeList;
+        if( reverseEdgeList )
+            delete [] reverseEdgeList;
+        delete [] localCSR;
         CSCGraph.del();
     }
+    // Release the representations that keep does not hold; returns what
+    // is kept. COO partitions only exist with edge partitioning, so
+    // RESIDENT_COO keeps the CSC with vertex partitioning. With
+    // RESIDENT_COO, the edge arrays of the whole graph are no longer used
+    // either (wholeGraph::del_edges()).
+    resident_t release( resident_t keep )
+    {
+        if( keep == RESIDENT_COO && part_ver )
+        {
+            cerr << "Warning: -mem coo needs edge partitioning (-v edge), keeping the CSC\n";
+            keep = RESIDENT_CSC;
+        }
+        resident = keep;
+        if( keep == RESIDENT_ALL )
+            return keep;
+        for( int p=0; p < coo_partition.get_num_partitions(); ++p )
+        {
+            localCSR[p].del();
+            if( keep == RESIDENT_CSC )
+                localEdgeList[p].del();
+        }
+        if( keep == RESIDENT_COO )
+            CSCGraph.del();
+        cerr << "Resident: " << ( keep == RESIDENT_COO ? "COO" : "CSC, neighbor lists" )
+             << endl;
+        return keep;
+    }
 
     const EdgeList<Edge> & get_edge_list_partition( intT p )
     {
@@ -722,12 +1286,96 @@ public:
     {
 	// Do transpositions on NUMA node storing graph partition
 	CSCGraph.transpose();
+        // The COO partitions of both directions are kept, so only the
+        // first transposition builds anything
+        if( !CSCGraph.isSymmetric && !part_ver && resident != RESIDENT_CSC )
+        {
+            if( !reverseEdgeList )
+                build_reverse_edge_lists();
+            std::swap( localEdgeList, reverseEdgeList );
+        }
     }
     bool transposed() const {
 	return CSCGraph.transposed; // Assume status of partitions matches whole graph
     }
 
 private:
+    // Partition GA: COO partitions, CSR partitions and the CSC graph
+    void build( wholeGraph<vertex> & GA, int coo_part, bool partition_source,
+                bool partition_vertex, bool partition_relabel )
+    {
+        timer par;
+        par.start();
+        if(partition_vertex)
+             partitionByVertex( GA, coo_part, coo_partition.as_array(), partition_relabel);
+        else
+             partitionByDegree( GA, coo_part, coo_partition.as_array(), partition_source,partition_relabel );
+#if FRONTIER_BITMAP
+        // Each partition owns whole words of the frontier bitmap
+        coo_partition.align_boundaries(64);
+#endif
+        coo_partition.compute_starts();
+#if CPU_PARTITION
+        coo_partition.compute_vertexstarts();
+#endif
+        cerr<<"Boundaries: "<<par.next()<<endl;
+          if(!partition_vertex){
+            cerr<<"edge partitioning...."<<endl;
+	    map_partitionL( coo_partition, [&]( int p ) {
+		    int i = coo_partition.node_of( p );
+                    if( partition_source)
+                    {
+                        localEdgeList[p] = COOPartitionBySour( GA, coo_partition.start_of(p), coo_partition.start_of(p+1),i);
+                    }
+                    else   //Partition Function for ICS and ICPP paper 
+                    {
+                        localEdgeList[p] = COOPartitionByDest( GA, coo_partition.start_of(p), coo_partition.start_of(p+1),i);
+                    }
+                    localEdgeList[p].summarize_sources();
+                } );
+	  }
+         cerr<<"COO: "<<par.stop()<<endl;
+        // The other stages read the edges in any order
+        GA.wait_for_all_edges();
+#if CSR_PUSH
+        // Only source partitioning pushes through the CSR partitions by
+        // default; with destination partitioning they are built from the
+        // in-edges on demand (partitioned_graph_view::build_csr(), CSR_LAZY)
+        if( partition_source )
+        {
+            par.start();
+            map_partitionL( coo_partition, [&]( int p ) {
+                    localCSR[p].build_by_source( GA.V.get(), coo_partition.start_of(p),
+                                                 coo_partition.start_of(p+1),
+                                                 coo_partition.node_of(p) );
+                } );
+            cerr<<"CSR: "<<par.stop()<<endl;
+        }
+#endif
+        //cerr<<"CSC Chunk"<<endl;
+        par.start();
+        CSCGraph = PartitionByDest(GA,0,GA.m,coo_part);
+        cerr<<"CSC compression: "<<par.next()<<endl;
+        CSCGraph.compute_csc_offsets();
+        cscpartitionByOwner(CSCGraph,coo_partition,CSCGraph.csc.as_array());
+        CSCGraph.csc.compute_starts(); 
+        cerr<<"CSC partitions: "<<par.next()<<endl;
+    }
+
+    // Identifies the graph and everything the partitions depend on
+    std::vector<uint64_t> snapshot_key( wholeGraph<vertex> & GA ) const
+    {
+        uint64_t k[] = { GA.content_hash(), (uint64_t)n, (uint64_t)m,
+                         GA.isSymmetric, (uint64_t)coo_partition.get_num_partitions(),
+                         source, part_ver, part_relabel,
+                         EDGES_HILBERT, FRONTIER_BITMAP, CSR_PUSH, COO_SOURCE_BLOCK,
+                         sizeof(intT), sizeof(intE), sizeof(Edge), EDGE_WORDS };
+        return std::vector<uint64_t>( k, k + sizeof(k)/sizeof(k[0]) );
+    }
+    void save_snapshot( const char * fname, const std::vector<uint64_t> & key );
+    bool load_snapshot( wholeGraph<vertex> & GA, const char * fname,
+                        const std::vector<uint64_t> & key );
+
 // These functions are specific to the partitioned graph. No one needs
 // to know about them, I think.
 // graphFilter is polymer method, partitioend graph:
@@ -741,73 +1389,113 @@ private:
 // Forward: each local vertex contains its own out-degree
     void partitionByDegree( wholeGraph<vertex> GA, int numOfNode, intT *sizeArr,
                             bool useOutDegree , bool useRelabel);
-    void cscpartitionByDegree( graph<vertex> GA, int numOfNode, intT *sizeArr,
-                            bool useOutDegree, bool useRelabel );
-    void cscpartitionByVertex( graph<vertex> GA, int numOfNode, intT *sizeArr,
-                            bool useRelabel );
+    void cscpartitionByOwner( const graph<vertex> & GA, const partitioner & owner,
+                              intT *sizeArr );
+    int relabelChunks( wholeGraph<vertex> & GA, int numOfNode, intT *sizeArr );
     void partitionByVertex( wholeGraph<vertex> GA, int numOfNode, intT *sizeArr,
                             bool useRelabel );
     graph<vertex> PartitionByDest(wholeGraph<vertex>& GA, int rangeLow, int rangeHi ,int numanode);
-    graph<vertex> PartitionBySour(wholeGraph<vertex>& GA, int rangeLow, int rangeHi ,int numanode);
     EdgeList<Edge> COOPartitionByDest(wholeGraph<vertex>& GA, int rangeLow, int rangeHi ,int numanode);
     EdgeList<Edge> COOPartitionBySour(wholeGraph<vertex>& GA, int rangeLow, int rangeHi ,int numanode);
+    void build_reverse_edge_lists();
     wholeGraph<vertex> PartitionByDestW(wholeGraph<vertex>& GA, int rangeLow, int rangeHi ,int numanode);
     wholeGraph<vertex> PartitionBySourW(wholeGraph<vertex>& GA, int rangeLow, int rangeHi ,int numanode);
 };
-// ======================================================================
-// Graph Filtering (Graph Partitioned)
-// ======================================================================
-//This method is partitioned by outdegree, CSR, store the all out-degree for
-//all local vertices of each partitions.
-//And part indegree for whole vertices
-// Place edge (u,v) in partition of u
+
+//Non-owning view of a partitioned_graph, passed by value through the
+//edgeMap API. Construction and copies only copy pointers and sizes, so
+//dispatching over partitions allocates nothing. The partitioned_graph
+//keeps ownership and must outlive the view; a transpose() of the graph
+//invalidates the transposed flag and COO partitions of existing views.
 template <class vertex>
-graph<vertex> partitioned_graph<vertex>::PartitionBySour(wholeGraph<vertex> &GA, int rangeLow, int rangeHi,int numanode)
+class partitioned_graph_view
 {
-    vertex *V = GA.V;
-    const intT n = GA.n;
-    bool isSymmetric = GA.isSymmetric;
+public:
+    typedef vertex vertex_type;
 
-    intT nnz = 0, nnzi = 0, nnzo = 0, ne = 0, ni=0;
-    for( intT i=0; i < n; ++i )
+    intT m,n;
+    bool source;
+    bool part_ver;
+    bool part_relabel;
+    resident_t resident;
+private:
+    partitioner_view coo_partition;
+    const EdgeList<Edge> * localEdgeList;
+    CSRPartition * localCSR;
+    graph_view<vertex> CSCGraph;
+public:
+    partitioned_graph_view( partitioned_graph<vertex> & G )
+        : m( G.m ), n( G.n ), source( G.source ), part_ver( G.part_ver ),
+          part_relabel( G.part_relabel ), resident( G.resident ),
+          coo_partition( G.coo_partition ),
+          localEdgeList( G.localEdgeList ), localCSR( G.localCSR ),
+          CSCGraph( G.CSCGraph ) { }
+
+    const EdgeList<Edge> & get_edge_list_partition( intT p ) const
     {
-            if( V[i].getInDegree() != 0 )
-                ++nnzi;
-            if( V[i].getOutDegree() != 0 )
-                ++nnzo;
+        return localEdgeList[p];
     }
-
-    graph<vertex> FG(n, GA.m, nnzi,nnzo,numanode,isSymmetric);
-    FG.CSCV.Interleave_allocate(FG.CSCVn);
-    FG.CSRV.Interleave_allocate(FG.CSRVn);
-
-    intT k=0;
-    for( intT i=0; i < n; ++i )
+    const CSRPartition & get_csr_partition( intT p ) const
+    {
+        return localCSR[p];
+    }
+    // Build the CSR partitions that are not built yet, from the in-edges
+    // of the whole graph (destination partitioning, see build()), by the
+    // first DENSE_FORWARD traversal or, without CSR_LAZY, after partitioning.
+    // They belong to the partitioned_graph, so this is done once for all views.
+    void build_csr()
+    {
+        int np = coo_partition.get_num_partitions();
+        int k = 0;
+        while( k < np && localCSR[k].built() )
+            ++k;
+        if( k == np )
+            return;
+        timer tm;
+        tm.start();
+        map_partitionL( coo_partition, [&]( int p ) {
+                if( !localCSR[p].built() )
+                    localCSR[p].build_by_destination( CSCGraph.V, n,
+                                                      coo_partition.start_of(p),
+                                                      coo_partition.start_of(p+1),
+                                                      coo_partition.node_of(p) );
+            } );
+        cerr<<"CSR: "<<tm.stop()<<endl;
+    }
+    const graph_view<vertex> & get_partition() const
     {
-        if( V[i].getInDegree() != 0 )
-        {
-            FG.CSCV[k].first = i;
-            FG.CSCV[k].second = V[i];
-            k++;
-        }
+        return CSCGraph;
     }
-    intT a=0;
-    for( intT j=0; j < n; ++j )
+    // Representations available to edgeMap (see resident_t)
+    bool has_coo() const
     {
-        if( V[j].getOutDegree() != 0 )
-        {
-            FG.CSRV[a].first = j;
-            FG.CSRV[a].second = V[j];
-            a++;
-        }
+        return !part_ver && resident != RESIDENT_CSC;
     }
-#if 0
-    cerr << "CSCCSRCompressed graph n=" << n << " Compressed=" << nnz
-         << " CSC=" << nnzi << " CSR=" << nnzo << " out-edges=" << ne 
-         << " in-edges" << ni << " compressed" << endl;
-#endif 
-    return FG;//return graph<vertex>(newVertexSet, GA.n, GA.m);
-}
+    bool has_csr() const
+    {
+        return resident == RESIDENT_ALL;
+    }
+    // CSC and the neighbor lists of the whole graph (sparse traversals)
+    bool has_csc() const
+    {
+        return resident != RESIDENT_COO;
+    }
+    int get_num_coo_partitions() const
+    {
+        return coo_partition.get_num_partitions();
+    }
+    partitioner_view get_partitioner() const
+    {
+        return coo_partition;
+    }
+    partitioner_view get_coo_partitioner() const
+    {
+        return coo_partition;
+    }
+};
+// ======================================================================
+// Graph Filtering (Graph Partitioned)
+// ======================================================================
 //This is used for MIX method 
 //get the wholeGraph for next source partition
 template <class vertex>
@@ -821,8 +1509,7 @@ wholeGraph<vertex> partitioned_graph<vertex>::PartitionByDestW(wholeGraph<vertex
     intT *inCounters = new intT [n];
     intT *inOffsets = new intT [n];
     {
-        parallel_for (intT i = 0; i < n; i++)
-        {
+        parallel_range( (intT)0, n, 1024, [&]( intT i ) {
             counters[i] = 0;
             inCounters[i] = 0;
             intT d = V[i].getOutDegree();
@@ -837,7 +1524,7 @@ wholeGraph<vertex> partitioned_graph<vertex>::PartitionByDestW(wholeGraph<vertex
                 if(rangeLow <= i && i < rangeHi)
                     inCounters[i] = V[i].getInDegree();
             }
-        }
+        } );
     }
     intT totalSize = 0;
     intT totalInSize = 0;
@@ -858,12 +1545,11 @@ wholeGraph<vertex> partitioned_graph<vertex>::PartitionByDestW(wholeGraph<vertex
 
     wholeGraph<vertex> FG(n, totalSize, isSymmetric);
     {
-        parallel_for (intT i = 0; i < n; i++)
-        {
+        parallel_range( (intT)0, n, 4096, [&]( intT i ) {
             FG.V[i].setOutDegree(counters[i]);
             if(!isSymmetric)
                 FG.V[i].setInDegree(inCounters[i]);
-        }
+        } );
     }
     delete [] counters;
     delete [] inCounters;
@@ -872,8 +1558,7 @@ wholeGraph<vertex> partitioned_graph<vertex>::PartitionByDestW(wholeGraph<vertex
     intE *inEdges = FG.inEdges;
 
     {
-        parallel_for (intT i = 0; i < n; i++)
-        {
+        parallel_range( (intT)0, n, 1024, [&]( intT i ) {
 #ifndef WEIGHTED
             intE *localEdges = &edges[offsets[i]];
 #else
@@ -931,7 +1616,7 @@ wholeGraph<vertex> partitioned_graph<vertex>::PartitionByDestW(wholeGraph<vertex
                     FG.V[i].setInNeighbors(localInEdges);
                 }
             }
-        }
+        } );
     }
 
     delete [] offsets;
@@ -950,8 +1635,7 @@ wholeGraph<vertex> partitioned_graph<vertex>::PartitionBySourW(wholeGraph<vertex
     intT *inCounters = new intT [n];
     intT *inOffsets = new intT [n];
     {
-        parallel_for (intT i = 0; i < n; i++)
-        {
+        parallel_range( (intT)0, n, 1024, [&]( intT i ) {
             counters[i] = 0;
             inCounters[i] = 0;
             if(!isSymmetric)
@@ -966,7 +1650,7 @@ wholeGraph<vertex> partitioned_graph<vertex>::PartitionBySourW(wholeGraph<vertex
 	    }
               if(rangeLow <= i && i < rangeHi)
                   counters[i] = V[i].getOutDegree();
-        }
+        } );
     }
     intT totalSize = 0;
     intT totalInSize = 0;
@@ -987,12 +1671,11 @@ wholeGraph<vertex> partitioned_graph<vertex>::PartitionBySourW(wholeGraph<vertex
 
     wholeGraph<vertex> FG(n, totalSize, isSymmetric);
     {
-        parallel_for (intT i = 0; i < n; i++)
-        {
+        parallel_range( (intT)0, n, 4096, [&]( intT i ) {
             FG.V[i].setOutDegree(counters[i]);
             if(!isSymmetric)
                 FG.V[i].setInDegree(inCounters[i]);
-        }
+        } );
     }
     delete [] counters;
     delete [] inCounters;
@@ -1000,8 +1683,7 @@ wholeGraph<vertex> partitioned_graph<vertex>::PartitionBySourW(wholeGraph<vertex
     intE *edges = FG.allocatedInplace;
     intE *inEdges = FG.inEdges;
     {
-        parallel_for (intT i = 0; i < n; i++)
-        {
+        parallel_range( (intT)0, n, 1024, [&]( intT i ) {
 #ifndef WEIGHTED
             intE *localInEdges = &inEdges[inOffsets[i]];
 #else
@@ -1058,7 +1740,7 @@ wholeGraph<vertex> partitioned_graph<vertex>::PartitionBySourW(wholeGraph<vertex
                 }
                 FG.V[i].setOutNeighbors(localEdges);
             }
-        }
+        } );
 
     }
 
@@ -1082,12 +1764,11 @@ graph<vertex> partitioned_graph<vertex>::PartitionByDest(wholeGraph<vertex> &GA,
     const intT n = GA.n;
     bool isSymmetric = GA.isSymmetric;
 
-    intT nnzi = 0;
-    for( intT i=0; i < n; ++i )
-    {
-       if( V[i].getInDegree() != 0 )
-          ++nnzi;
-    }
+    bool *nonzero = new bool [n];
+    parallel_range( (intT)0, n, 4096, [&]( intT i ) {
+            nonzero[i] = V[i].getInDegree() != 0;
+        } );
+    intT nnzi = sequence::sum( nonzero, n );
 
     graph<vertex> FG(n, GA.m, nnzi,num_part,isSymmetric);
     FG.CSCV.Interleave_allocate(FG.CSCVn);
@@ -1095,16 +1776,9 @@ graph<vertex> partitioned_graph<vertex>::PartitionByDest(wholeGraph<vertex> &GA,
       FG.V = GA.V;
 //    FG.CSRV.Interleave_allocate(FG.CSRVn);
 
-    intT k=0;
-    for( intT i=0; i < n; ++i )
-    {
-        if( V[i].getInDegree() != 0 )
-        {
-            FG.CSCV[k].first = i;
-            FG.CSCV[k].second = V[i];
-            k++;
-        }
-    }
+    sequence::pack( FG.CSCV.get(), nonzero, (intT)0, n,
+                    [&]( intT i ) { return make_pair( i, V[i] ); } );
+    delete [] nonzero;
 #if 0
     cerr << "CSCCSRCompressed graph n=" << n 
          << " CSC=" << FG.CSCVn
@@ -1113,32 +1787,36 @@ graph<vertex> partitioned_graph<vertex>::PartitionByDest(wholeGraph<vertex> &GA,
     return FG;
 }
 //EDGELIST IMPLEMENTATION FOR GRAPH PARTITION
+//The edges of a partition are not copied to the list and sorted there:
+//their keys in EdgeOrder are computed from the adjacency lists in
+//parallel and EdgeList::fill_sorted() writes them out in order.
 template <class vertex>
 EdgeList<Edge> partitioned_graph<vertex>::COOPartitionByDest(wholeGraph<vertex> &GA, int rangeLow, int rangeHi,int numanode)
 {
     vertex *V = GA.V;
     const intT n = GA.n;
-    bool isSymmetric = GA.isSymmetric;
-    intT totalSize = 0;
-        for (intT i = rangeLow; i < rangeHi; i++)
-              totalSize += V[i].getInDegree();
-        EdgeList<Edge> el (totalSize,n,numanode);
-        long k = 0;
-       
-        for( intT i=rangeLow; i<rangeHi; i++ )
-        {
-            for( intT j=0; j < V[i].getInDegree(); ++j )
-            {
-                intT d = V[i].getInNeighbor( j );
-#ifndef WEIGHTED
-                el[k++] = Edge( d, i );
-#else
-                el[k++] = Edge( d, i, V[i].getInWeight( j ) );
+    intT nv = rangeHi - rangeLow;
+    intT *offsets = new intT [nv+1];
+    offsets[0] = 0;
+    for (intT i = 0; i < nv; i++)
+        offsets[i+1] = offsets[i] + V[rangeLow+i].getInDegree();
+    EdgeList<Edge> el (offsets[nv],n,numanode);
+    EdgeOrder order( n );
+    GA.wait_for_edges( rangeLow, rangeHi, true );
+    el.fill_sorted( [&]( uint64_t * keys, intE * weights ) {
+            parallel_range( rangeLow, rangeHi, 256, [&]( intT i ) {
+                intT k = offsets[i-rangeLow];
+                intT d = V[i].getInDegree();
+                for( intT j=0; j < d; ++j )
+                {
+                    keys[k+j] = order.key( V[i].getInNeighbor( j ), i );
+#ifdef WEIGHTED
+                    weights[k+j] = V[i].getInWeight( j );
 #endif
-	    }
-         }
-    assert( k == totalSize );
-    //cerr<<"VERTER_CHUNCK: "<<rangeHi-rangeLow<<" and EDGE: "<<totalSize<<endl;
+                }
+            } );
+        } );
+    delete [] offsets;
     return el;
 }
 
@@ -1147,27 +1825,208 @@ EdgeList<Edge> partitioned_graph<vertex>::COOPartitionBySour(wholeGraph<vertex>
 {
     vertex *V = GA.V;
     const intT n = GA.n;
-    bool isSymmetric = GA.isSymmetric;
-    intT totalSize = 0;
-        for (intT i = rangeLow; i < rangeHi; i++)
-              totalSize += V[i].getOutDegree();
+    intT nv = rangeHi - rangeLow;
+    intT *offsets = new intT [nv+1];
+    offsets[0] = 0;
+    for (intT i = 0; i < nv; i++)
+        offsets[i+1] = offsets[i] + V[rangeLow+i].getOutDegree();
+    EdgeList<Edge> el (offsets[nv],n,numanode);
+    EdgeOrder order( n );
+    GA.wait_for_edges( rangeLow, rangeHi, false );
+    el.fill_sorted( [&]( uint64_t * keys, intE * weights ) {
+            parallel_range( rangeLow, rangeHi, 256, [&]( intT i ) {
+                intT k = offsets[i-rangeLow];
+                intT d = V[i].getOutDegree();
+                for( intT j=0; j < d; ++j )
+                {
+                    keys[k+j] = order.key( i, V[i].getOutNeighbor( j ) );
+#ifdef WEIGHTED
+                    weights[k+j] = V[i].getOutWeight( j );
+#endif
+                }
+            } );
+        } );
+    delete [] offsets;
+    return el;
+}
 
-        EdgeList<Edge> el (totalSize,n,numanode);
-        long k = 0;
-        for( intT i=rangeLow; i<rangeHi; i++ )
-        {
-            for( intT j=0; j < V[i].getOutDegree(); ++j )
+//COO partitions of the transposed graph, with the same vertex ownership
+//as localEdgeList: every edge is flipped and moved to the partition
+//owning its new destination (or new source, when partitioning by source,
+//which is the partition it comes from). Each partition counts its edges
+//per target partition, the counts are scanned per target, and the
+//partitions then copy their edges to the target lists, which are
+//allocated on the nodes of their partitions and sorted there.
+template <class vertex>
+void partitioned_graph<vertex>::build_reverse_edge_lists()
+{
+    partitioner_view part( coo_partition );
+    intT np = part.get_num_partitions();
+    intT *pos = new intT [np*np]; // pos[p*np+q]: edges from p to q, then offsets
+    timer tm;
+    tm.start();
+    map_partitionL( part, [&]( int p ) {
+            const EdgeList<Edge> & EL = localEdgeList[p];
+            std::fill( &pos[p*np], &pos[(p+1)*np], (intT)0 );
+            for( size_t i=0; i < EL.get_num_edges(); ++i )
+                ++pos[p*np + part.partition_of( source ? EL[i].getDestination()
+                                                        : EL[i].getSource() )];
+        } );
+    reverseEdgeList = new EdgeList<Edge>[np];
+    map_partitionL( part, [&]( int q ) {
+            intT total = 0;
+            for( intT p=0; p < np; ++p )
             {
-                intT d = V[i].getOutNeighbor( j );
-#ifndef WEIGHTED
-                el[k++] = Edge( i, d );
-#else
-                el[k++] = Edge( i, d, V[i].getOutWeight( j ) );
+                intT c = pos[p*np+q];
+                pos[p*np+q] = total;
+                total += c;
+            }
+            reverseEdgeList[q] = EdgeList<Edge>( total, n, part.node_of(q) );
+        } );
+    map_partitionL( part, [&]( int p ) {
+            const EdgeList<Edge> & EL = localEdgeList[p];
+            for( size_t i=0; i < EL.get_num_edges(); ++i )
+            {
+                Edge e = EL[i];
+                e.flipEdge();
+                intT q = part.partition_of( source ? e.getSource()
+                                                   : e.getDestination() );
+                reverseEdgeList[q][pos[p*np+q]++] = e;
+            }
+        } );
+    map_partitionL( part, [&]( int q ) {
+            reverseEdgeList[q].sort();
+            reverseEdgeList[q].summarize_sources();
+        } );
+    delete [] pos;
+    cerr<<"COO transpose: "<<tm.stop()<<endl;
+}
+
+//Snapshot layout, after the header (see snapshot.h): the sizes of the COO
+//partitions, every COO partition (EdgeList::save()), every CSR partition
+//(CSRPartition::save()) with CSR_PUSH and source partitioning, the sizes of the CSC partitions
+//and the vertex ids of CSCV. The in-edges of the CSC graph are those of
+//the whole graph and are not stored.
+template <class vertex>
+void partitioned_graph<vertex>::save_snapshot( const char * fname, const std::vector<uint64_t> & key )
+{
+    timer tm;
+    tm.start();
+    intT np = coo_partition.get_num_partitions();
+    snapshot::writer w( fname, key );
+    w.array( coo_partition.as_array(), np );
+    for( intT p=0; p < np; ++p )
+    {
+        if( part_ver )
+            w.put( (uint64_t)0 );   // no COO partitions, see build()
+        else
+            localEdgeList[p].save( w );
+    }
+#if CSR_PUSH
+    if( source )
+        for( intT p=0; p < np; ++p )
+            localCSR[p].save( w );
 #endif
-	    }
-        }
-    	assert( k == totalSize );
-    return el;
+    w.array( CSCGraph.csc.as_array(), np );
+    w.put( (uint64_t)CSCGraph.CSCVn );
+    intT *ids = new intT [CSCGraph.CSCVn];
+    parallel_range( (intT)0, CSCGraph.CSCVn, 4096, [&]( intT i ) {
+            ids[i] = CSCGraph.CSCV[i].first;
+        } );
+    w.array( ids, CSCGraph.CSCVn );
+    delete [] ids;
+    if( w.close() )
+        cerr<<"Snapshot saved to "<<fname<<": "<<tm.stop()<<endl;
+    else
+        cerr<<"Warning: could not write snapshot "<<fname<<": "<<strerror(errno)<<endl;
+}
+
+//Read the partitions from a snapshot written by save_snapshot(). The
+//file is mapped and its arrays are located first; the partitions are
+//then copied in parallel to memory on their NUMA nodes.
+template <class vertex>
+bool partitioned_graph<vertex>::load_snapshot( wholeGraph<vertex> & GA, const char * fname,
+                                               const std::vector<uint64_t> & key )
+{
+    snapshot::reader r;
+    if( !r.open( fname, key ) )
+    {
+        r.close();
+        if( access( fname, F_OK ) == 0 )
+            cerr<<"Snapshot "<<fname<<" does not match the graph or the options, rebuilding"<<endl;
+        return false;
+    }
+    timer tm;
+    tm.start();
+    intT np = coo_partition.get_num_partitions();
+    const intT *sizes = r.array<intT>( np );
+    std::vector<intT> num_edges( np );
+    std::vector<const Edge *> edges( np );
+    std::vector< const pair<intT,intT> * > blocks( np );
+    for( intT p=0; p < np; ++p )
+    {
+        num_edges[p] = r.get<uint64_t>();
+        edges[p] = r.array<Edge>( num_edges[p] );
+        blocks[p] = r.array< pair<intT,intT> >(
+            ( num_edges[p] + COO_SOURCE_BLOCK - 1 ) / COO_SOURCE_BLOCK );
+    }
+#if CSR_PUSH
+    std::vector<intT> num_sources( np );
+    std::vector<intT> csr_edges( np );
+    std::vector<bool> local_dst( np );
+    std::vector<const intE *> csr_sources( np ), csr_dst( np );
+    std::vector<const intT *> csr_offsets( np );
+    for( intT p=0; p < np && source; ++p )
+    {
+        num_sources[p] = r.get<uint64_t>();
+        csr_edges[p] = r.get<uint64_t>();
+        local_dst[p] = r.get<uint64_t>();
+        csr_sources[p] = r.array<intE>( num_sources[p] );
+        csr_offsets[p] = r.array<intT>( num_sources[p]+1 );
+        csr_dst[p] = r.array<intE>( csr_edges[p]*EDGE_WORDS );
+    }
+#endif
+    const intT *csc_sizes = r.array<intT>( np );
+    intT cscn = r.get<uint64_t>();
+    const intT *ids = r.array<intT>( cscn );
+    if( !r.good() )
+    {
+        r.close();
+        cerr<<"Snapshot "<<fname<<" is truncated, rebuilding"<<endl;
+        return false;
+    }
+
+    std::copy( sizes, sizes + np, coo_partition.as_array() );
+    coo_partition.compute_starts();
+#if CPU_PARTITION
+    coo_partition.compute_vertexstarts();
+#endif
+    map_partitionL( coo_partition, [&]( int p ) {
+            int node = coo_partition.node_of( p );
+            if( !part_ver )
+            {
+                localEdgeList[p] = EdgeList<Edge>( num_edges[p], n, node );
+                localEdgeList[p].load( edges[p], blocks[p] );
+            }
+#if CSR_PUSH
+            if( source )
+                localCSR[p].load( num_sources[p], csr_edges[p], local_dst[p],
+                                  csr_sources[p], csr_offsets[p], csr_dst[p], node );
+#endif
+        } );
+
+    CSCGraph = graph<vertex>( n, m, cscn, np, GA.isSymmetric );
+    CSCGraph.V = GA.V;
+    CSCGraph.CSCV.Interleave_allocate( cscn );
+    parallel_range( (intT)0, cscn, 4096, [&]( intT i ) {
+            CSCGraph.CSCV[i] = make_pair( ids[i], GA.V[ids[i]] );
+        } );
+    CSCGraph.compute_csc_offsets();
+    std::copy( csc_sizes, csc_sizes + np, CSCGraph.csc.as_array() );
+    CSCGraph.csc.compute_starts();
+    r.close();
+    cerr<<"Snapshot loaded from "<<fname<<": "<<tm.stop()<<endl;
+    return true;
 }
 
 // ======================================================================
@@ -1180,17 +2039,7 @@ void partitioned_graph<vertex>::partitionByVertex(wholeGraph<vertex> GA, int num
   if(useRelabel)
   {
     cerr<<"Relabel chunk size..."<<endl;
-    const intT n = GA.n;
-    for (int i = 0; i < numOfNode; i++)
-        sizeArr[i] = 0;
-   
-    intT counter=0;
-    for (intT j=0; j<n; ++j)
-    {
-        sizeArr[counter]++;
-        if (j<n-1 && GA.V[j+1].getInDegree()>GA.V[j].getInDegree() && counter<numOfNode-1)
-            counter++;
-    } 
+    relabelChunks( GA, numOfNode, sizeArr );
    }
    else
    {
@@ -1204,84 +2053,25 @@ void partitioned_graph<vertex>::partitionByVertex(wholeGraph<vertex> GA, int num
      sizeArr[numOfNode-1]=GA.n-chunck;
    }
 }
-//For wholegraph degree
+//CSC partition p holds the destinations of CSCV owned by COO partition p,
+//so that the COO and CSC traversals, the frontiers and the arrays placed
+//by part_allocate() agree on the NUMA node of every vertex. CSCV is sorted
+//by vertex id.
 template <class vertex>
-void partitioned_graph<vertex>::cscpartitionByDegree(graph<vertex> GA, int numOfNode, intT *sizeArr,  bool useOutDegree, bool useRelabel)
+void partitioned_graph<vertex>::cscpartitionByOwner(const graph<vertex> & GA, const partitioner & owner, intT *sizeArr)
 {
-  if (useRelabel)
-  {
+    const pair<intT,vertex> *V = GA.CSCV.get();
     const intT n = GA.CSCVn;
-    for (int i = 0; i < numOfNode; i++)
-        sizeArr[i] = 0;
-   
-    intT counter=0;
-    for (intT j=0; j<n; ++j)
-    {
-        sizeArr[counter]++;
-        if (j<n-1 && GA.CSCV[j+1].second.getInDegree()>GA.CSCV[j].second.getInDegree() && counter<numOfNode-1)
-            counter++;
-    } 
-    assert( counter+1 == numOfNode );
-  }
-  else
-  {
-    const intT n = GA.CSCVn;
-    intT *degrees = new intT [n];
-    if (useOutDegree)
-            parallel_for(intT i = 0; i < n; i++) degrees[i] = GA.CSCV[i].second.getOutDegree();
-    else
-            parallel_for(intT i = 0; i < n; i++) degrees[i] = GA.CSCV[i].second.getInDegree();
-
-    intT edges[numOfNode];
-    for (int i = 0; i < numOfNode; i++)
+    intT prev = 0;
+    for (int p = 0; p < owner.get_num_partitions(); p++)
     {
-        edges[i] = 0;
-        sizeArr[i] = 0;
+        intT end = std::lower_bound( V+prev, V+n, owner.start_of(p+1),
+                                     []( const pair<intT,vertex> & a, intT v ) {
+                                         return a.first < v; } ) - V;
+        sizeArr[p] = end - prev;
+        prev = end;
     }
-    
-    intT averageDegree = GA.m / numOfNode;
-    int counter = 0;
-    for (intT i = 0; i < n; i++)
-    {
-        edges[counter]+=degrees[i];
-        sizeArr[counter]++;
-        if (edges[counter]<averageDegree && degrees[i+1]+edges[counter]> 1.1*averageDegree)
-            counter++;
-        if (edges[counter]>=averageDegree && counter <numOfNode-1)
-            counter++;
-    }
-    assert( counter+1 == numOfNode );
-    delete [] degrees;
-  }
-}
-
-template <class vertex>
-void partitioned_graph<vertex>::cscpartitionByVertex(graph<vertex> GA, int numOfNode, intT *sizeArr,  bool useRelabel)
-{
-  if (useRelabel)
-  {
-    const intT n = GA.CSCVn;
-    for (int i = 0; i < numOfNode; i++)
-        sizeArr[i] = 0;
-   
-    intT counter=0;
-    for (intT j=0; j<n; ++j)
-    {
-        sizeArr[counter]++;
-        if (j<n-1 && GA.CSCV[j+1].second.getInDegree()>GA.CSCV[j].second.getInDegree() && counter<numOfNode-1)
-            counter++;
-    } 
-  }
-   else
-   {
-    intT chunck=0;
-    for ( intT i=0; i < numOfNode-1; ++i)
-    {
-        sizeArr[i]=GA.CSCVn/numOfNode;
-        chunck+=sizeArr[i];
-    }
-    sizeArr[numOfNode-1]=GA.CSCVn-chunck;
-   }
+    assert( prev == n );
 }
 
 template <class vertex>
@@ -1290,68 +2080,76 @@ void partitioned_graph<vertex>::partitionByDegree(wholeGraph<vertex> GA, int num
   if (useRelabel)
   {
     cerr<<"Relabel chunk size..."<<endl;
-    const intT n = GA.n;
-    for (int i = 0; i < numOfNode; i++)
-        sizeArr[i] = 0;
-   
-    intT counter=0;
-    for (intT j=0; j<n; ++j)
-    {
-        sizeArr[counter]++;
-        if (j<n-1 && GA.V[j+1].getInDegree()>GA.V[j].getInDegree() && counter<numOfNode-1)
-            counter++;
-    } 
-    assert( counter+1 == numOfNode );
+    int used = relabelChunks( GA, numOfNode, sizeArr );
+    assert( used == numOfNode );
   }
   else{
     cerr<<"Original chunk size..."<<endl;
-    intT* degrees = new intT [n];
+    // Partitions are filled in vertex order: a partition ends at the
+    // first vertex that brings it to averageDegree edges, or before the
+    // first vertex that would take it above 1.1*averageDegree. Both ends
+    // are found by binary search in the prefix sums of the degrees.
+    intT* sums = new intT [n];
     if (useOutDegree)
     {
-        {
-            parallel_for(intT i = 0; i < n; i++) degrees[i] = GA.V[i].getOutDegree();
-        }
+        parallel_range( (intT)0, n, 4096, [&]( intT i ) {
+                sums[i] = GA.V[i].getOutDegree();
+            } );
     }
     else
     {
-        {
-            parallel_for(intT i = 0; i < n; i++) degrees[i] = GA.V[i].getInDegree();
-        }
-    }
-    intT * edges= new intT [numOfNode];
-    for (int i = 0; i < numOfNode; i++)
-    {
-        edges[i] = 0;
-        sizeArr[i] = 0;
+        parallel_range( (intT)0, n, 4096, [&]( intT i ) {
+                sums[i] = GA.V[i].getInDegree();
+            } );
     }
-    
+    sequence::scanI( sums, sums, n, addF<intT>(), (intT)0 );
+
     intT averageDegree = GA.m / numOfNode;
     cerr<<"Average Degree: "<<averageDegree<<endl;
     int counter = 0;
-    for (intT i = 0; i < n; i++)
-    {
-        edges[counter]+=degrees[i];
-        sizeArr[counter]++;
-        if (edges[counter]<averageDegree && degrees[i+1]+edges[counter]> 1.1*averageDegree)
-            counter++;
-        if (edges[counter]>=averageDegree && counter <numOfNode-1)
-            counter++;
-    }
-#define PSIZE 0
-#if PSIZE
-     intT a=0,b=0;
-    for (intT i=0; i<numOfNode;i++)
-    {
-        cerr<<" Part " <<i<<" with size "<<sizeArr[i]<<" and edges "<<edges[i]<<endl;
-        a+=edges[i];
-        b+=sizeArr[i];
-    }
-    assert(a==GA.m);
-    assert(b==GA.n);
-    abort();
-#endif
-    assert( counter+1 == numOfNode );
-    delete [] degrees;
-    delete [] edges;
+    intT start = 0;
+    for ( ; counter < numOfNode-1 && start < n; ++counter )
+    {
+        intT base = start == 0 ? 0 : sums[start-1];
+        intT full = std::lower_bound( sums+start, sums+n, base+averageDegree ) - sums;
+        intT over = std::partition_point( sums+start+1, sums+n, [&]( intT s ) {
+                return !( s - base > 1.1*averageDegree ); } ) - sums;
+        intT end = std::min( full, over == n ? n : over-1 );
+        if( end >= n )
+            break;
+        sizeArr[counter] = end - start + 1;
+        start = end + 1;
+    }
+    sizeArr[counter] = n - start;
+    for (int i = counter+1; i < numOfNode; i++)
+        sizeArr[i] = 0;
+    delete [] sums;
    }
 }
+
+//Chunks of a relabelled (VEBO) graph, whose vertices are sorted by
+//decreasing in-degree within each chunk: a chunk ends where the in-degree
+//increases. Returns the number of chunks, at most numOfNode.
+template <class vertex>
+int partitioned_graph<vertex>::relabelChunks(wholeGraph<vertex> & GA, int numOfNode, intT *sizeArr)
+{
+    const intT n = GA.n;
+    bool *rise = new bool [n];
+    parallel_range( (intT)0, n, 4096, [&]( intT j ) {
+            rise[j] = j<n-1 && GA.V[j+1].getInDegree()>GA.V[j].getInDegree();
+        } );
+    _seq<intT> ends = sequence::packIndex( rise, n );
+    delete [] rise;
+    int chunks = std::min( (intT)numOfNode-1, (intT)ends.n );
+    intT start = 0;
+    for (int i = 0; i < chunks; i++)
+    {
+        sizeArr[i] = ends.A[i] - start + 1;
+        start = ends.A[i] + 1;
+    }
+    sizeArr[chunks] = n - start;
+    for (int i = chunks+1; i < numOfNode; i++)
+        sizeArr[i] = 0;
+    ends.del();
+    return chunks+1;
+}
@@ -33,6 +33,9 @@
 #include <string>
 #include <assert.h>
 #include <algorithm>
+#include <utility>
+#include <vector>
+#include <type_traits>
 #include <sys/mman.h>
 #ifndef __APPLE__
 #include <numa.h>
@@ -41,12 +44,36 @@
 #include "gettime.h"
 #include "utils.h"
 #include "graph-numa.h"
+#include "frontier.h"
 #include "IO.h"
 #include "parseCommandLine.h"
 #ifndef PART96
 #define PART96 0
 #endif
 
+//Vertices with more edges than this have their edges split over several
+//tasks in the sparse and CSC traversals
+#ifndef HIGH_DEGREE_THRESHOLD
+#define HIGH_DEGREE_THRESHOLD 1000
+#endif
+
+//Number of edges per task in the edge-balanced sparse and CSC traversals
+#ifndef EDGE_CHUNK
+#define EDGE_CHUNK 2048
+#endif
+
+//Let each COO partition choose between sparse, COO and CSC traversal
+//when partitioning by source (see edgeMapPerPartition)
+#ifndef PARTITION_DIRECTION
+#define PARTITION_DIRECTION 1
+#endif
+
+//Report after every dense edgeMap how many edges update a destination
+//owned by another NUMA node than the one traversing them (debugging)
+#ifndef NUMA_WRITE_CHECK
+#define NUMA_WRITE_CHECK 0
+#endif
+
 #ifndef PAPI_CACHE
 #define PAPI_CACHE 0
 #endif
@@ -93,17 +120,19 @@ class partitioned_vertices
 public:
     intT numVertices;    // active vertices number for dense part
     intT d_m;           // dense part, boolean array
-    mmap_ptr<bool> d;
+    dense_frontier d;   // bool or bitmap, see frontier.h
     bool has_dense;    // flag if dense representation is present
     intT *s;            //sparse active vertices array
     intT num_out_edges; //acitve vertices's out-degree for sparse/dense selection
     bool bit;           //flag for bits creation, easy skip collection for BP/PR
+    intTpair *part_stats; //active vertices and out-degrees per COO partition, if counted (see edgeMapPerPartition)
     //Create the initial partitioned frontier with one start vertex.
     //Used for traversal algorithm, such as BFS,BC and BellmanFord
     static partitioned_vertices create(intT n, intT v, intT initialOutdegree)
     {
 
         partitioned_vertices pv;
+        pv.part_stats = NULL;
         pv.numVertices=n;
         pv.d_m = 1;
         pv.has_dense = false;
@@ -119,6 +148,7 @@ public:
     static partitioned_vertices empty()
     {
         partitioned_vertices pv;
+        pv.part_stats = NULL;
         pv.d_m = 0;
         pv.bit=false;
         pv.numVertices=0;
@@ -129,15 +159,15 @@ public:
         return pv;
     }
     //Create dense frontier for the dense part
-    static partitioned_vertices dense(intT n, const partitioner & part)
+    static partitioned_vertices dense(intT n, partitioner_view part)
     {
         partitioned_vertices pv;
+        pv.part_stats = NULL;
         pv.numVertices=n;
         pv.bit=false;
-        pv.d.part_allocate(part);
-        const int perNode = part.get_num_per_node_partitions();
+        pv.d.allocate(part);
         //loop(j,part,perNode,pv.d[j]=0);
-        map_vertexL( part, [&](intT j) { pv.d[j]=0; } );
+        pv.d.clear(part);
 
         pv.d_m = 0;
         pv.has_dense = true;
@@ -149,6 +179,7 @@ public:
     static partitioned_vertices sparse(intT n)
     {
         partitioned_vertices pv;
+        pv.part_stats = NULL;
         pv.numVertices=n;
         pv.bit=false;
         pv.d_m = 0;
@@ -166,13 +197,14 @@ public:
     //not to copy in each algorithm defined
     //Use for Components, BP, PageRank, SPMV and PRDelta
 
-    static partitioned_vertices bits(const partitioner & part, intT n, intT initialOutdegree)
+    static partitioned_vertices bits(partitioner_view part, intT n, intT initialOutdegree)
     {
         partitioned_vertices pv;
+        pv.part_stats = NULL;
         pv.num_out_edges = initialOutdegree;
         pv.s = NULL;
         pv.numVertices=n;
-        pv.d.part_allocate(part);
+        pv.d.allocate(part);
         pv.bit=true;
         pv.d_m = n;
         pv.has_dense = true;
@@ -180,9 +212,10 @@ public:
     }
     //Used for vertexFilter to create the array with number of vertices and boolean array
     //This is using for the radii algorithm, and VertexFilter
-    static partitioned_vertices boolean(intT n, mmap_ptr<bool> bits,intT activeM, intT out_edges)
+    static partitioned_vertices boolean(intT n, dense_frontier bits,intT activeM, intT out_edges)
     {
         partitioned_vertices pv;
+        pv.part_stats = NULL;
         pv.bit=false;
         pv.numVertices=n;
         pv.num_out_edges = out_edges;
@@ -197,12 +230,13 @@ public:
     static partitioned_vertices indice(intT n, mmap_ptr<intT> indice, intT activeM, intT out_edges)
     {
         partitioned_vertices pv;
+        pv.part_stats = NULL;
         pv.bit=false;
         pv.numVertices=n;
         pv.num_out_edges = out_edges;
         pv.d_m = activeM;
         pv.s = indice;
-        pv.d = 0;
+        pv.d = dense_frontier();
         pv.has_dense = false;
         return pv;
     }
@@ -210,6 +244,7 @@ public:
     void del()
     {
         if(s!=NULL) delete [] s;
+        if(part_stats!=NULL) delete [] part_stats;
          d.del();
     }
     //get the intT array for sparse iteration
@@ -225,20 +260,19 @@ public:
     }
 
     //Represent the frontier as the dense format (boolean dense array [0,1,0,1,0,1,1,1,.....]), used for the edgeMapDense function
-    void toDense(const partitioner & part)
+    void toDense(partitioner_view part)
     {
         // The dense pull operation requires to know for every vertex whether
         // it is active. So we convert all sparse partitions. The dense push
         // only needs to know for vertices within partitions traversed in
         // dense format. In those cases we could avoid creating the dense
         // representation, e.g., if the flag is set to use DENSE_FORWARD.
-        const int perNode = part.get_num_per_node_partitions();
         if (!d)
         {
-            d.part_allocate(part);
+            d.allocate(part);
            // loop(j,part,perNode,d[j]=0);
-            map_vertexL( part, [&](intT j){ d[j]=0; } );
-	    parallel_for(intT i=0; i<d_m; i++) d[s[i]] = 1;
+            d.clear(part);
+	    parallel_range( (intT)0, d_m, 2048, [&]( intT i ) { d.set_atomic(s[i]); } );
         }
             has_dense = true;
     }
@@ -247,7 +281,7 @@ public:
     {
         if( s == NULL )
         {
-            _seq<intT> R = sequence::packIndex(d,numVertices);
+            _seq<intT> R = d.pack(numVertices);
             if (d_m != R.n)
             {
                 cout<<"bad stored value of m"<<endl;
@@ -271,36 +305,6 @@ public:
     }
 };
 
-//To collect all outdegree for partitioned graph
-template<class vertex>
-class GoutDegree
-{
-public:
-    graph<vertex> &PG;
-    bool* dense;
-
-    GoutDegree(graph<vertex>& pg, bool* pdense):PG(pg),dense(pdense) {}
-    pair<intT, intT> operator()(intT i)
-    {
-        return make_pair((intT)dense[i], dense[i]? PG.V[i].getOutDegree():(intT)0);
-    }
-
-};
-//Get part out-degree of partitioned graph
-template<class vertex>
-class GoutDegreeV
-{
-public:
-    graph<vertex> G;
-    intT *s;
-
-    GoutDegreeV(graph<vertex> G_, intT* s_) : G(G_), s(s_) { }
-    intT operator()( intT i )
-    {
-        return G.V[s[i]].getOutDegree();
-    }
-};
-
 //Use for filter function for set the out-degree array without -1 for sparse
 struct nonNegF
 {
@@ -313,28 +317,37 @@ struct nonNegF
 //options to edgeMap for different versions of dense edgeMap (default is DENSE)
 enum options { DENSE, DENSE_FORWARD};
 
+//flags for removing duplicates, allocated once and kept at -1
+//between calls
+static intT *dupFlags = NULL;
+static intT dupFlagsN = 0;
+inline intT *getDuplicateFlags(intT n)
+{
+    if(dupFlagsN < n)
+    {
+        if(dupFlags) delete [] dupFlags;
+        dupFlags = new intT [n];
+        parallel_range( (intT)0, n, 4096, [&]( intT i ) { dupFlags[i]=-1; } );
+        dupFlagsN = n;
+    }
+    return dupFlags;
+}
+
 //remove duplicate integers in [0,...,n-1]
 void remDuplicates(intT* indices, intT* flags, intT m, intT n)
 {
-    //make flags for first time
+    //use the persistent flags unless given
     if(flags == NULL)
+        flags = getDuplicateFlags(n);
     {
-        flags = new intT [n];
-        {
-            parallel_for(intT i=0; i<n; i++) flags[i]=-1;
-        }
-    }
-    {
-        parallel_for(intT i=0; i<m; i++)
-        {
+        parallel_range( (intT)0, m, 2048, [&]( intT i ) {
             if(indices[i] != -1 && flags[indices[i]] == -1)
                 CAS(&flags[indices[i]],(intT)-1,i);
-        }
+        } );
     }
     //reset flags
     {
-        parallel_for(intT i=0; i<m; i++)
-        {
+        parallel_range( (intT)0, m, 2048, [&]( intT i ) {
             if(indices[i] != -1)
             {
                 if(flags[indices[i]] == i)  //win
@@ -343,7 +356,7 @@ void remDuplicates(intT* indices, intT* flags, intT m, intT n)
                 }
                 else indices[i] = -1; //lost
             }
-        }
+        } );
     }
 }
 
@@ -361,577 +374,853 @@ void remDuplicates(intT* indices, intT* flags, intT m, intT n)
 //update destination dst->ngh (V.getOutNeighbor(j))
 //sequential version
 // FOR CSC//CSR//COO experiment with 1 threads
+//The update functions take an edge argument that depends on the
+//algorithm: nothing (update(s,d)), the edge weight (update(s,d,w), e.g.
+//BellmanFord and SPMV) or the edge index (update(s,d,pos), e.g. BP). The
+//kind is detected from the functor type, so kernels are compiled for the
+//functor they run and a weighted build can also run unweighted functors.
+//Edge indices are recognized by the cached update(cache,s,d,pos).
+enum edge_arg { EDGE_NONE, EDGE_WEIGHT, EDGE_INDEX };
+
 template<class F>
-inline bool edgeOpFwdSeq( intT src, intT pos, intT dst, intE w, F f )
-{
-#ifdef MORE_ARG
-    return f.cond(dst) && f.update(src,dst,pos);
-#else // MORE_ARG
-#ifndef WEIGHTED
-    return f.cond(dst) && f.update(src,dst);
-#else
-    return f.cond(dst) && f.update(src,dst,w);
-#endif // WEIGHTED
-#endif // MORE_ARG
-}
-//atomic version
-template<class F>
-inline bool edgeOpFwd( intT src, intT pos, intT dst, intE w, F f )
+struct edge_arg_of
 {
-#ifdef MORE_ARG
-    return f.cond(dst) && f.updateAtomic(src,dst,pos);
-#else // MORE_ARG
-#ifndef WEIGHTED
-    return f.cond(dst) && f.updateAtomic(src,dst);
-#else
-    return f.cond(dst) && f.updateAtomic(src,dst,w);
-#endif // WEIGHTED
-#endif // MORE_ARG
-}
-//When frontier.bit = true
+    template<class G>
+    static auto index_test( int ) -> decltype(
+        std::declval<G&>().update( std::declval<typename G::cache_t&>(),
+                                   intT(), intT(), intT() ),
+        std::true_type() );
+    template<class G>
+    static std::false_type index_test( ... );
+    template<class G>
+    static auto weight_test( int ) -> decltype(
+        std::declval<G&>().update( intT(), intT(), intE() ),
+        std::true_type() );
+    template<class G>
+    static std::false_type weight_test( ... );
+
+    static const int value = decltype( index_test<F>( 0 ) )::value
+        ? EDGE_INDEX
+        : decltype( weight_test<F>( 0 ) )::value ? EDGE_WEIGHT : EDGE_NONE;
+};
+
+template<class F, int A = edge_arg_of<F>::value>
+struct edge_call;
+
 template<class F>
-inline bool edgeOpBwd( intT src, intT pos, intT dst, intE w, F f)
+struct edge_call<F, EDGE_NONE>
 {
-#ifdef MORE_ARG
-    return f.update(src,dst,pos);
-#else // MORE_ARG
-#ifndef WEIGHTED
-    return f.update(src,dst);
-#else
-    return f.update(src,dst,w);
-#endif // WEIGHTED
-#endif // MORE_ARG
-}
+    static bool update( F & f, intT src, intT dst, intT pos, intE w )
+    {
+        return f.update(src,dst);
+    }
+    static bool updateAtomic( F & f, intT src, intT dst, intT pos, intE w )
+    {
+        return f.updateAtomic(src,dst);
+    }
+    static bool update( F & f, typename F::cache_t & cache,
+                        intT src, intT dst, intT pos, intE w )
+    {
+        return f.update(cache,src);
+    }
+};
+
 template<class F>
-inline bool edgeOpIn( intT src, intT pos, intT dst, intE w, F f,
-                      bool *next )
+struct edge_call<F, EDGE_WEIGHT>
 {
-    if( edgeOpBwd( src, pos, dst, w, f) )
+    static bool update( F & f, intT src, intT dst, intT pos, intE w )
     {
-        next[dst]=1;
+        return f.update(src,dst,w);
     }
-        return f.cond(dst);
-}
+    static bool updateAtomic( F & f, intT src, intT dst, intT pos, intE w )
+    {
+        return f.updateAtomic(src,dst,w);
+    }
+    static bool update( F & f, typename F::cache_t & cache,
+                        intT src, intT dst, intT pos, intE w )
+    {
+        return f.update(cache,src,w);
+    }
+};
+
 template<class F>
-inline bool edgeOpIn( intT src, typename F::cache_t & cache,
-                      intT pos, intT dst, intE w, F f,
-                      bool *next )
+struct edge_call<F, EDGE_INDEX>
 {
-#ifdef MORE_ARG
-    if (f.update(cache,src,dst,pos))
+    static bool update( F & f, intT src, intT dst, intT pos, intE w )
     {
-        next[dst]=1;
+        return f.update(src,dst,pos);
     }
-#else
-#ifndef WEIGHTED
-    if( f.update(cache,src) )
+    static bool updateAtomic( F & f, intT src, intT dst, intT pos, intE w )
     {
-        next[dst]=1;
+        return f.updateAtomic(src,dst,pos);
     }
-#else
-    if( f.update(cache,src,w) )
+    static bool update( F & f, typename F::cache_t & cache,
+                        intT src, intT dst, intT pos, intE w )
     {
-        next[dst]=1;
+        return f.update(cache,src,dst,pos);
     }
-#endif
-#endif
-    return f.cond(dst);
+};
+
+//sequential version
+// FOR CSC//CSR//COO experiment with 1 threads
+template<class F>
+inline bool edgeOpFwdSeq( intT src, intT pos, intT dst, intE w, F f )
+{
+    return f.cond(dst) && edge_call<F>::update(f,src,dst,pos,w);
 }
-//When frontier.bit == false
-//edgeOpBwd: Backward operator, src->ngh (destination) , dst->id (source)
+//atomic version
 template<class F>
+inline bool edgeOpFwd( intT src, intT pos, intT dst, intE w, F f )
+{
+    return f.cond(dst) && edge_call<F>::updateAtomic(f,src,dst,pos,w);
+}
+//edgeOpBwd: Backward operator, src->ngh (destination) , dst->id (source)
+//The frontier is all_vertices when frontier.bit == true, in which case
+//the test on src is compiled away.
+template<class F, class FT>
 inline bool edgeOpBwd( intT src, intT pos, intT dst, intE w, F f,
-                       bool *frontier )
+                       const FT & frontier )
 {
-#ifdef MORE_ARG
-    return frontier[src] && f.update(src,dst,pos);
-#else // MORE_ARG
-#ifndef WEIGHTED
-    return frontier[src] && f.update(src,dst);
-#else
-    return frontier[src] && f.update(src,dst,w);
-#endif // WEIGHTED
-#endif // MORE_ARG
+    return frontier[src] && edge_call<F>::update(f,src,dst,pos,w);
 }
 
-template<class F>
+template<class F, class FT, class NT>
 inline bool edgeOpIn( intT src, intT pos, intT dst, intE w, F f,
-                      bool *frontier, bool *next )
+                      const FT & frontier, NT next )
 {
     if( edgeOpBwd( src, pos, dst, w, f, frontier ) )
     {
-        next[dst]=1;
+        next.set(dst);
     }
         return f.cond(dst);
 }
-template<class F>
+template<class F, class FT, class NT>
 inline bool edgeOpIn( intT src, typename F::cache_t & cache,
                       intT pos, intT dst, intE w, F f,
-                      bool *frontier, bool *next )
+                      const FT & frontier, NT next )
 {
-#ifdef MORE_ARG
-    if (frontier[src] && f.update(cache,src,dst,pos))
-    {
-        next[dst]=1;
-    }
-#else
-#ifndef WEIGHTED
-    if( frontier[src] && f.update(cache,src) )
+    if( frontier[src] && edge_call<F>::update(f,cache,src,dst,pos,w) )
     {
-        next[dst]=1;
+        next.set(dst);
     }
-#else
-    if( frontier[src] && f.update(cache,src,w) )
-    {
-        next[dst]=1;
-    }
-#endif
-#endif
     return f.cond(dst);
 }
-//When frontier.bit ==true
-template<class F>
-inline bool edgeOpBwdAtomic( intT src, intT pos, intT dst, intE w, F f)
+template<class F, class FT>
+inline bool edgeOpBwdAtomic( intT src, intT pos, intT dst, intE w, F f,
+                             const FT & frontier )
 {
-#ifdef MORE_ARG
-    return f.updateAtomic(src,dst,pos);
-#else // MORE_ARG
-#ifndef WEIGHTED
-    return f.updateAtomic(src,dst);
-#else
-    return f.updateAtomic(src,dst,w);
-#endif // WEIGHTED
-#endif // MORE_ARG
+    return frontier[src] && edge_call<F>::updateAtomic(f,src,dst,pos,w);
 }
-
-template<class F>
+template<class F, class FT, class NT>
 inline bool edgeOpInAtomic( intT src, intT pos, intT dst, intE w, F f,
-                            bool *next )
+                            const FT & frontier, NT next )
 {
-    if( edgeOpBwdAtomic( src, pos, dst, w, f ) )
+    if( edgeOpBwdAtomic( src, pos, dst, w, f, frontier ) )
     {
-        next[dst]=1;
+        next.set(dst);
         // return f.cond(dst);
     }
     return true;
 }
-//When frontier.bit ==false
-template<class F>
-inline bool edgeOpBwdAtomic( intT src, intT pos, intT dst, intE w, F f,
-                             bool *frontier )
+
+
+
+//Frontier in which every vertex is active (frontier.bit == true)
+struct all_vertices
 {
-#ifdef MORE_ARG
-    return frontier[src] && f.updateAtomic(src,dst,pos);
-#else // MORE_ARG
-#ifndef WEIGHTED
-    return frontier[src] && f.updateAtomic(src,dst);
-#else
-    return frontier[src] && f.updateAtomic(src,dst,w);
-#endif // WEIGHTED
-#endif // MORE_ARG
-}
-template<class F>
-inline bool edgeOpInAtomic( intT src, intT pos, intT dst, intE w, F f,
-                            bool *frontier, bool *next )
+    bool operator[] ( intT v ) const
+    {
+        return true;
+    }
+};
+
+//Pull the in-edges [js,je) of destination id. If partitioning by source
+//vertices or if the edges of id are split over several tasks, other tasks
+//update id as well and the atomic update function is used. atomic and
+//F::use_cache are compile-time constants, so each instance keeps a single
+//loop.
+template<bool atomic, class F, class vertex, class FT, class NT>
+inline void edgeMapDenseCSCVertex(intT id, vertex & V, intT js, intT je,
+                                  const FT & vertices, F f, NT out)
 {
-    if( edgeOpBwdAtomic( src, pos, dst, w, f, frontier ) )
+    if (!f.cond(id))
+        return;
+    if (atomic)
     {
-        next[dst]=1;
-        // return f.cond(dst);
+        for(intT j=js; j<je; j++)
+        {
+            intT ngh = V.getInNeighbor(j);
+            edgeOpInAtomic( ngh, j, id, V.getInWeight(j), f, vertices, out );
+        }
+    }
+    else if(F::use_cache)
+    {
+        typename F::cache_t cache;
+        f.create_cache(cache,id);
+        for(intT j=js; j<je; j++)
+        {
+            intT ngh = V.getInNeighbor(j);
+            if( !edgeOpIn( ngh, cache, j, id, V.getInWeight(j), f, vertices, out ) )
+                break;
+        }
+        f.commit_cache(cache,id);
+    }
+    else     //use_cache ==false
+    {
+        for(intT j=js; j<je; j++)
+        {
+            intT ngh = V.getInNeighbor(j);
+            if( !edgeOpIn( ngh, j, id, V.getInWeight(j), f, vertices, out ) )
+                break;
+        }
     }
-    return true;
 }
 
-
-
-//If partitioning by source vertices, avoiding data race
-//using the atomic update function
-template<class F, class vertex>
-bool* edgeMapDenseCSC(graph<vertex> GA, bool * vertices,bool bit,
-                      F f, bool *next, intT rangeLow, intT rangeHi, bool source, bool parallel = 0)
+//Pull over the destinations CSCV[rangeLow,rangeHi). With PART96 the range
+//is traversed sequentially. Otherwise its in-edges are split into chunks
+//of EDGE_CHUNK edges: a destination with up to HIGH_DEGREE_THRESHOLD
+//in-edges is processed whole by the chunk holding its first edge, larger
+//ones are shared by all chunks they overlap.
+template<bool source, class F, class vertex, class FT, class NT>
+void edgeMapDenseCSCRange(graph_view<vertex> GA, const FT & vertices,
+                          F f, NT out, intT rangeLow, intT rangeHi)
 {
     pair<intT,vertex> *G=GA.CSCV;
-    if (bit)
-    {
-     if (source) // TODO: bring this condition outside loop
-     {
-#if PART96
-       for (intT i=rangeLow; i<rangeHi; i++)
-#else
-       parallel_for (intT i=rangeLow; i<rangeHi; i++)
-#endif
-       {
-         intT id = G[i].first;
-         if (f.cond(id))
-         {
-            vertex V= G[i].second;
-            intT d = V.getInDegree();
-            if(!parallel || d < 1000)
-            {
-		    // TODO: only parallel if d large enough
-               for(intT j=0; j<d; j++)
-                {
-                    intT ngh = V.getInNeighbor(j);
-                    edgeOpInAtomic( ngh, j, id, V.getInWeight(j), f, next );
-                }
-            }
-            else
-            {
-               parallel_for(intT j=0; j<d; j++)
-                {
-                    intT ngh = V.getInNeighbor(j);
-                    edgeOpInAtomic( ngh, j, id, V.getInWeight(j), f, next );
-                }
-            }
-          }
-        }   
-     }       
-      else 
-      {
 #if PART96
-       for (intT i=rangeLow; i<rangeHi; i++)
-#else
-       parallel_for (intT i=rangeLow; i<rangeHi; i++)
-#endif
-         {
-            intT id = G[i].first;
-            if (f.cond(id))
-            {
-               vertex V= G[i].second;
-               intT d = V.getInDegree();
-               if(!parallel || d < 1000)
-                {
-                    if(f.use_cache)
-                    {
-                        typename F::cache_t cache;
-                        f.create_cache(cache,id);
-
-                        for(intT j=0; j<d; j++)
-                        {
-
-                            intT ngh = V.getInNeighbor(j);
-                            if( !edgeOpIn( ngh, cache, j, id, V.getInWeight(j), f, next ) )
-                                break;
-                        }
-
-                        f.commit_cache(cache,id);
-                    }
-                    else     //use_cache ==false
-                    {
-                        for(intT j=0; j<d; j++)
-                        {
-                            intT ngh = V.getInNeighbor(j);
-                            if( !edgeOpIn( ngh, j, id, V.getInWeight(j), f, next ) )
-                                break;
-                        }
-                    }
-                }
-                else     //parallel&&d>1000
-                {
-                    parallel_for(intT j=0; j<d; j++)
-                    {
-                        intT ngh = V.getInNeighbor(j);
-                        edgeOpInAtomic( ngh, j, id, V.getInWeight(j), f, next );
-                    }
-                }
-            }
-         }
-      }
+    for (intT i=rangeLow; i<rangeHi; i++)
+    {
+        vertex & V = G[i].second;
+        edgeMapDenseCSCVertex<source>( G[i].first, V, 0, V.getInDegree(),
+                                       vertices, f, out );
     }
-    else{
-     if (source) // TODO: bring this condition outside loop
-     {
-#if PART96
-       for (intT i=rangeLow; i<rangeHi; i++)
 #else
-       parallel_for (intT i=rangeLow; i<rangeHi; i++)
-#endif
-       {
-         intT id = G[i].first;
-         if (f.cond(id))
-         {
-            vertex V = G[i].second;
-            intT d = V.getInDegree();
-            if(!parallel || d < 1000)
-            {
-	        // TODO: only parallel if d large enough
-               for(intT j=0; j<d; j++)
-                {
-                    intT ngh = V.getInNeighbor(j);
-                    edgeOpInAtomic( ngh, j, id, V.getInWeight(j), f, vertices, next );
-                }
-            }
-            else
-            {
-               cerr<<"atomic"<<endl;
-               parallel_for(intT j=0; j<d; j++)
-                {
-                    intT ngh = V.getInNeighbor(j);
-                    edgeOpInAtomic( ngh, j, id, V.getInWeight(j), f, vertices, next );
-                }
-            }
-          }
-        }   
-     }       
-      else 
-      {
-#if PART96
-       for (intT i=rangeLow; i<rangeHi; i++)
-#else
-       parallel_for (intT i=rangeLow; i<rangeHi; i++)
+    const intT *off = GA.CSCOffsets;
+    intT es = off[rangeLow], ee = off[rangeHi];
+    intT nchunks = (ee - es + EDGE_CHUNK - 1) / EDGE_CHUNK;
+    parallel_range( (intT)0, nchunks, 1, [&]( intT c ) {
+        intT cs = es + c*EDGE_CHUNK;
+        intT ce = std::min( cs + EDGE_CHUNK, ee );
+        // destination holding the first edge of the chunk
+        intT i = std::upper_bound( &off[rangeLow], &off[rangeHi+1], cs ) - off - 1;
+        for( ; i < rangeHi && off[i] < ce; i++ )
+        {
+            vertex & V = G[i].second;
+            intT d = off[i+1] - off[i];
+            if( d > HIGH_DEGREE_THRESHOLD )
+                edgeMapDenseCSCVertex<true>( G[i].first, V,
+                                       std::max( cs, off[i] ) - off[i],
+                                       std::min( ce, off[i+1] ) - off[i],
+                                       vertices, f, out );
+            else if( off[i] >= cs )
+                edgeMapDenseCSCVertex<source>( G[i].first, V, 0, d,
+                                       vertices, f, out );
+        }
+    } );
 #endif
-         {
-           intT id = G[i].first;
-            if (f.cond(id))
-            {
-               vertex V = G[i].second;
-               intT d = V.getInDegree();
-               if(!parallel || d < 1000)
-                {
-                    if(f.use_cache)
-                    {
-                        typename F::cache_t cache;
-                        f.create_cache(cache,id);
-
-                        for(intT j=0; j<d; j++)
-                        {
-
-                            intT ngh = V.getInNeighbor(j);
-                            if( !edgeOpIn( ngh, cache, j, id, V.getInWeight(j), f, vertices, next ) )
-                                break;
-                        }
-
-                        f.commit_cache(cache,id);
-                    }
-                    else     //use_cache ==false
-                    {
-                        for(intT j=0; j<d; j++)
-                        {
-                            intT ngh = V.getInNeighbor(j);
-                            if( !edgeOpIn( ngh, j, id, V.getInWeight(j), f, vertices, next ) )
-                                break;
-                        }
-                    }
-                }
-                else     //parallel&&d>1000
-                {
-                    parallel_for(intT j=0; j<d; j++)
-                    {
-                        intT ngh = V.getInNeighbor(j);
-                        edgeOpInAtomic( ngh, j, id, V.getInWeight(j), f, vertices, next );
-                    }
-                }
-            }
-         }
-      }
+}
+
+//If partitioning by source vertices, avoiding data race
+//using the atomic update function. CSC range p holds the destinations of
+//COO partition p (see cscpartitionByOwner()), so next may skip atomics
+//when a single task covers the range.
+template<class F, class vertex, class NT>
+void edgeMapDenseCSC(graph_view<vertex> GA, const dense_frontier & vertices,bool bit,
+                      F f, NT next, intT rangeLow, intT rangeHi, bool source)
+{
+    // One instance per combination of the runtime flags
+    if (bit)
+    {
+        if (source)
+            edgeMapDenseCSCRange<true>( GA, all_vertices(), f, next, rangeLow, rangeHi );
+        else
+            edgeMapDenseCSCRange<false>( GA, all_vertices(), f, next, rangeLow, rangeHi );
+    }
+    else
+    {
+        if (source)
+            edgeMapDenseCSCRange<true>( GA, vertices, f, next, rangeLow, rangeHi );
+        else
+            edgeMapDenseCSCRange<false>( GA, vertices, f, next, rangeLow, rangeHi );
     }
-    return next;
 }
-template <class F, class vertex>
-bool* edgeMapDenseForwardCSR(graph<vertex> GA, bool *vertices, bool bit, F f, bool* next, intT rangeLow, intT rangeHi)   // partitioned_vertices instead of vertices
+
+//Push the out-edges of the active sources of CSR partition P. When all
+//destinations lie in the partition (destination partitioning) a single
+//task pushes them without atomics. Otherwise the sources are split over
+//tasks, those with more than HIGH_DEGREE_THRESHOLD edges over several,
+//and destinations are updated atomically.
+template <bool local, class F, class FT, class NT>
+void edgeMapDenseForwardCSRRange(const CSRPartition & P, const FT & vertices, F f, NT out)
 {
-    // timer fm;
-    // fm.start();
-    pair<intT,vertex> *G = GA.CSRV;
-    if(bit)
+    intT ns = P.get_num_sources();
+    if (local)
     {
-      parallel_for (intT i=rangeLow; i<rangeHi; i++)
-      {
-          intT id = G[i].first;
-          vertex V = G[i].second;
-          intT d = V.getOutDegree();
-          if(d < 1000)
-          {
-                for(intT j=0; j<d; j++)
-                {
-                    uintT ngh = V.getOutNeighbor(j);
-                    if( edgeOpFwd( id, j, ngh, V.getOutWeight(j), f ) )
-                    {
-                        next[ngh] = 1;
-                    }
-                }
-           }
-            else //d>1000
+        for (intT i=0; i<ns; i++)
+        {
+            intT src = P.source(i);
+            if (!vertices[src])
+                continue;
+            intT js = P.begin(i), je = P.end(i);
+            for (intT j=js; j<je; j++)
             {
-                parallel_for(intT j=0; j<d; j++)
-                {
-                    uintT ngh = V.getOutNeighbor(j);
-                    if( edgeOpFwd( id, j, ngh, V.getOutWeight(j), f ) )
-                    {
-                        next[ngh] = 1;
-                    }
-                }
+                intT ngh = P.destination(j);
+                if( edgeOpFwdSeq( src, j-js, ngh, P.weight(j), f ) )
+                    out.set(ngh);
             }
-      }
-     }
-     else{
-      parallel_for (intT i=rangeLow; i<rangeHi; i++)
-       {
-         intT id = G[i].first;
-         if (vertices[id])
-         {
-            vertex V = G[i].second;
-            intT d = V.getOutDegree();
-            if(d < 1000)
+        }
+        return;
+    }
+    parallel_range( (intT)0, ns, 64, [&]( intT i ) {
+        intT src = P.source(i);
+        if (!vertices[src])
+            return;
+        intT js = P.begin(i), je = P.end(i);
+        if(je-js <= HIGH_DEGREE_THRESHOLD)
+        {
+            for (intT j=js; j<je; j++)
             {
-                for(intT j=0; j<d; j++)
-                {
-                    uintT ngh = V.getOutNeighbor(j);
-                    if( edgeOpFwd( id, j, ngh, V.getOutWeight(j), f ) )
-                    {
-                        next[ngh] = 1;
-                    }
-                }
-            }
-            else //d>1000
-            {
-                parallel_for(intT j=0; j<d; j++)
-                {
-                    uintT ngh = V.getOutNeighbor(j);
-                    if( edgeOpFwd( id, j, ngh, V.getOutWeight(j), f ) )
-                    {
-                        next[ngh] = 1;
-                    }
-                }
+                intT ngh = P.destination(j);
+                if( edgeOpFwd( src, j-js, ngh, P.weight(j), f ) )
+                    out.set(ngh);
             }
         }
-      }
-    }
-    return next;
+        else
+        {
+            parallel_range( js, je, 1024, [&]( intT j ) {
+                intT ngh = P.destination(j);
+                if( edgeOpFwd( src, j-js, ngh, P.weight(j), f ) )
+                    out.set(ngh);
+            } );
+        }
+    } );
 }
-//COO edgelist
-template<class F, class Edge>
-bool* edgeMapDense(const EdgeList<Edge> & EL, bool* vertices, bool bit, F f, bool *next,
-                   bool parallel = false)
+template <class F, class NT>
+void edgeMapDenseForwardCSR(const CSRPartition & P, const dense_frontier & vertices, bool bit, F f, NT out)
 {
-    typename EdgeList<Edge>::const_iterator E=EL.cend();
-    if (bit)
+    if (P.local_destinations())
     {
-#if PART96
-       for( typename EdgeList<Edge>::const_iterator
-                  I=EL.cbegin(); I != E; ++I )
-#else
-       parallel_for( typename EdgeList<Edge>::const_iterator
-                  I=EL.cbegin(); I != E; ++I )
-#endif
-       {
-        const Edge &eref = *I;
+        if (bit)
+            edgeMapDenseForwardCSRRange<true>( P, all_vertices(), f, out.owned() );
+        else
+            edgeMapDenseForwardCSRRange<true>( P, vertices, f, out.owned() );
+    }
+    else
+    {
+        if (bit)
+            edgeMapDenseForwardCSRRange<false>( P, all_vertices(), f, out );
+        else
+            edgeMapDenseForwardCSRRange<false>( P, vertices, f, out );
+    }
+}
 
-        intT src = eref.getSource();
-        intT dst = eref.getDestination();
-        intE wgh = eref.getWeight();
-        /* When operating on partitions that have been created such that
-         * all incoming edges to a node are located in the current partition,
-         * then we can execute a non-atomic edge-op. */
-       if( f.cond(dst) )
-       {
-#if PART96
-            edgeOpIn( src, /*unused*/1, dst, wgh, f, next );
+//Whether the dense edgeMap pushes through the CSR partitions: when asked
+//for with DENSE_FORWARD and, with source partitioning, instead of the
+//CSC pull, which needs atomics as well there. Not on a transposed graph,
+//as the CSR partitions keep the original direction, nor for functors
+//taking the index of the edge when a partition holds partial out-lists,
+//nor when the CSR partitions are released (-mem).
+template <class F, class vertex>
+inline bool forward_dense(partitioned_graph_view<vertex> GA, char option)
+{
+#if CSR_PUSH
+    if (!GA.has_csr() || GA.get_partition().transposed)
+        return false;
+    if (edge_arg_of<F>::value == EDGE_INDEX && !GA.source)
+        return false;
+    return option == DENSE_FORWARD || GA.source;
 #else
-            edgeOpInAtomic( src, 1, dst, wgh, f, next );
+    return false;
 #endif
-       }
-      }
+}
 
-    }
-    else{
-#if PART96 
-       for( typename EdgeList<Edge>::const_iterator
-                  I=EL.cbegin(); I != E; ++I )
-#else
-       parallel_for( typename EdgeList<Edge>::const_iterator
-                  I=EL.cbegin(); I != E; ++I )
-#endif
-       
-       {
+//Whether a block of edges with sources [lo,hi] may hold active sources.
+//Never skip when all vertices are active (no summary is built).
+template<class FT>
+inline bool any_active(const FT & vertices, const active_summary & active, intT lo, intT hi)
+{
+    return active.any( lo, hi );
+}
+inline bool any_active(const all_vertices & vertices, const active_summary & active, intT lo, intT hi)
+{
+    return true;
+}
+
+//COO edgelist
+//With PART96 and partitioning by destination, a partition activates only
+//vertices it owns and can set them without atomics (atomic is false).
+//With source partitioning, destinations are shared by all partitions and
+//the updates are atomic.
+//Blocks of edges whose sources are all inactive in the active summary
+//are skipped.
+template<bool atomic, class F, class Edge, class FT, class NT>
+void edgeMapDenseCOOBlocks(const EdgeList<Edge> & EL, intT bs, intT be,
+                           const FT & vertices, F & f, NT & next,
+                           const active_summary & active)
+{
+    typename EdgeList<Edge>::const_iterator E=EL.cend();
+    for( intT b=bs; b < be; ++b )
+    {
+        const pair<intT,intT> & range = EL.get_block_sources(b);
+        if( !any_active( vertices, active, range.first, range.second ) )
+            continue;
+        typename EdgeList<Edge>::const_iterator
+            I=EL.cbegin()+b*COO_SOURCE_BLOCK;
+        typename EdgeList<Edge>::const_iterator
+            BE=std::min( I+COO_SOURCE_BLOCK, E );
+        for( ; I != BE; ++I )
+        {
         const Edge &eref = *I;
 
         intT src = eref.getSource();
         intT dst = eref.getDestination();
         intE wgh = eref.getWeight();
-        /* When operating on partitions that have been created such that
-         * all incoming edges to a node are located in the current partition,
-         * then we can execute a non-atomic edge-op. */
         if( f.cond(dst) )
         {
+            if( atomic )
+                edgeOpInAtomic( src, 1, dst, wgh, f, vertices, next );
+            else
+                edgeOpIn( src, /*unused*/1, dst, wgh, f, vertices, next );
+        }
+        }
+    }
+}
+template<bool atomic, class F, class Edge, class FT, class NT>
+void edgeMapDenseCOO(const EdgeList<Edge> & EL, const FT & vertices, F f, NT next,
+                     const active_summary & active)
+{
+    intT nb = EL.get_num_blocks();
 #if PART96 
-            edgeOpIn( src, /*unused*/1, dst, wgh, f, vertices, next );
+    edgeMapDenseCOOBlocks<atomic>( EL, 0, nb, vertices, f, next, active );
 #else
-            edgeOpInAtomic( src, 1, dst, wgh, f, vertices, next );
+    parallel_range( (intT)0, nb, 1, [&]( intT b ) {
+            edgeMapDenseCOOBlocks<atomic>( EL, b, b+1, vertices, f, next, active );
+        } );
 #endif
-        }
-       }
+}
+//Sweep of a COO partition. source is true when the graph is partitioned
+//by source: other partitions then update the same destinations and the
+//updates are atomic, as they are without PART96.
+template<class F, class Edge, class NT>
+void edgeMapDense(const EdgeList<Edge> & EL, const dense_frontier & vertices, bool bit, F f, NT next,
+                   const active_summary & active, bool source)
+{
+    // One instance per combination of the runtime flags
+    if (source || !PART96)
+    {
+        if (bit)
+            edgeMapDenseCOO<true>( EL, all_vertices(), f, next, active );
+        else
+            edgeMapDenseCOO<true>( EL, vertices, f, next, active );
+    }
+    else
+    {
+        if (bit)
+            edgeMapDenseCOO<false>( EL, all_vertices(), f, next, active );
+        else
+            edgeMapDenseCOO<false>( EL, vertices, f, next, active );
     }
-    return next;
 }
 
-template <class F, class vertex>
-pair<uintT,intT*> edgeMapSparseWithG(graph<vertex> GA, partitioned_vertices frontier, uintT Totalm, F f, intT remDups=0, intT* flags=NULL)
+//output buffers of the sparse edgeMap, reused across calls
+static frontier_buffers sparseOut;
+
+//counters of the vertices activated by the dense edgeMap
+static frontier_counters denseStats;
+
+//summary of the active sources of the dense COO traversals, reused
+//across calls
+static active_summary denseActive;
+
+#if NUMA_WRITE_CHECK
+//Counts the edges of the dense traversals by whether their destination
+//is owned (through its COO partition) by the NUMA node traversing them.
+//The node of a task is that of the CPU it starts on.
+class numa_write_check
 {
-    //timer sm;
-    // sm.start();
-    vertex *V=GA.V;
-    uintT *degrees = new uintT [Totalm];
-    parallel_for (intT i = 0; i < Totalm; i++)
-    degrees[i] = V[frontier.s[i]].getOutDegree();
+    struct worker
+    {
+        intT local, remote;
+        char pad[64];   // keep workers on separate cache lines
+    };
+    worker *W;
+    int num_workers;
 
+public:
+    numa_write_check() : W( 0 ), num_workers( 0 ) { }
 
-    uintT* offsets = degrees;
-    uintT outEdgeCount = sequence::plusScan(offsets, degrees, Totalm);
-    intT* outEdges = new intT [outEdgeCount];
+    void reset()
+    {
+        if( num_workers < getWorkers() )
+        {
+            if( W )
+                delete [] W;
+            num_workers = getWorkers();
+            W = new worker [num_workers];
+        }
+        for( int i=0; i < num_workers; ++i )
+            W[i].local = W[i].remote = 0;
+    }
+    static int current_node()
+    {
+        return numa_nodes::get().node_of_cpu( sched_getcpu() );
+    }
+    void add( int node, int owner, intT edges )
+    {
+        worker &w = W[getWorkerNum()];
+        if( node == owner )
+            w.local += edges;
+        else
+            w.remote += edges;
+    }
+    // Destinations of the CSC range [s,e)
+    template<class vertex>
+    void add_csc( partitioner_view owner, const graph_view<vertex> & WG,
+                  intT s, intT e )
+    {
+        int node = current_node();
+        for( intT i=s; i < e; ++i )
+            add( node, owner.node_of( owner.partition_of( WG.CSCV[i].first ) ),
+                 WG.CSCOffsets[i+1] - WG.CSCOffsets[i] );
+    }
+    void add_coo( partitioner_view owner, const EdgeList<Edge> & EL )
+    {
+        int node = current_node();
+        for( size_t i=0; i < EL.get_num_edges(); ++i )
+            add( node, owner.node_of( owner.partition_of( EL[i].getDestination() ) ), 1 );
+    }
+    void add_csr( partitioner_view owner, const CSRPartition & P )
+    {
+        int node = current_node();
+        for( intT i=0; i < P.get_num_sources(); ++i )
+            for( intT j=P.begin( i ); j < P.end( i ); ++j )
+                add( node, owner.node_of( owner.partition_of( P.destination( j ) ) ), 1 );
+    }
+    void report( const char * traversal ) const
+    {
+        intT local = 0, remote = 0;
+        for( int i=0; i < num_workers; ++i )
+        {
+            local += W[i].local;
+            remote += W[i].remote;
+        }
+        cerr << "edgeMap " << traversal << ": " << remote << " of "
+             << local+remote << " edges update a vertex of another node\n";
+    }
+};
+
+static numa_write_check writeCheck;
+#endif
 
-    parallel_for (intT k = 0; k < Totalm; k++)
+//prefix sums of the out-degrees of the sparse frontier, reused across
+//calls
+static intT *sparseOffsets = NULL;
+static intT sparseOffsetsN = 0;
+
+//Sparse edgeMap: push the out-edges of the active vertices. The edges are
+//split into chunks of EDGE_CHUNK edges using the prefix sums of the
+//out-degrees, so a chunk may start in the middle of a vertex and high
+//degree vertices are shared by several tasks. Activated vertices are
+//appended to worker-local buffers that are concatenated once, and the sum
+//of their out-degrees is returned in outEdges. With remDups, a vertex is
+//only appended by the thread that claims its flag.
+template <class F, class vertex>
+pair<uintT,intT*> edgeMapSparseWithG(graph_view<vertex> GA, partitioned_vertices frontier, uintT Totalm, F f, intT & outEdges, bool remDups=false)
+{
+    vertex *V=GA.V;
+    intT *flags = remDups ? getDuplicateFlags(GA.n) : NULL;
+    sparseOut.prepare();
+
+    if(sparseOffsetsN < (intT)Totalm+1)
     {
-        intT v = frontier.s[k];
-        intT o = offsets[k];
-        vertex vert = V[v];
+        if(sparseOffsets) delete [] sparseOffsets;
+        sparseOffsetsN = 2*Totalm+1;
+        sparseOffsets = new intT [sparseOffsetsN];
+    }
+    intT *offsets = sparseOffsets;
+    parallel_range( (intT)0, (intT)Totalm, 2048, [&]( intT k ) {
+            offsets[k] = V[frontier.s[k]].getOutDegree();
+        } );
+    intT outEdgeCount = sequence::plusScan(offsets, offsets, (intT)Totalm);
+    offsets[Totalm] = outEdgeCount;
+
+    intT nchunks = (outEdgeCount + EDGE_CHUNK - 1) / EDGE_CHUNK;
+    parallel_range( (intT)0, nchunks, 1, [&]( intT c ) {
+        intT cs = c*EDGE_CHUNK;
+        intT ce = std::min( cs + EDGE_CHUNK, outEdgeCount );
+        // frontier vertex holding the first edge of the chunk
+        intT k = std::upper_bound( &offsets[0], &offsets[Totalm+1], cs ) - offsets - 1;
+        for( ; k < (intT)Totalm && offsets[k] < ce; k++ )
+        {
+            intT v = frontier.s[k];
+            vertex vert = V[v];
+            intT je = std::min( ce, offsets[k+1] ) - offsets[k];
+            for (intT j = std::max( cs, offsets[k] ) - offsets[k]; j < je; j++)
+            {
+                intT ngh = vert.getOutNeighbor(j);
+                if( edgeOpFwd( v, j, ngh, vert.getOutWeight(j), f )
+                    && ( !flags || CAS(&flags[ngh],(intT)-1,(intT)0) ) )
+                    sparseOut.append(ngh, V[ngh].getOutDegree());
+            }
+        }
+    } );
+    intT* nextIndices;
+    intTpair stats = sparseOut.gather(nextIndices);
+    uintT nextM = stats.first;
+    outEdges = stats.second;
+    //reset flags
+    if(flags)
+        parallel_range( (intT)0, (intT)nextM, 2048, [&]( intT i ) {
+                flags[nextIndices[i]] = -1;
+            } );
+    return pair<uintT,intT*>(nextM, nextIndices);
+}
+
+//Push the out-edges of the active vertices in [rangeLow,rangeHi) using
+//the CSR of the whole graph, for partitions with few active vertices.
+template <class F, class vertex, class FT, class NT>
+void edgeMapSparseRange(graph_view<vertex> GA, const FT & vertices,
+                        F f, NT next, intT rangeLow, intT rangeHi)
+{
+    vertex *V=GA.V;
+    parallel_range( rangeLow, rangeHi, 64, [&]( intT i ) {
+        if( !vertices[i] )
+            return;
+        vertex vert = V[i];
         intT d = vert.getOutDegree();
-        if(d < 1000)
+        if(d <= HIGH_DEGREE_THRESHOLD)
         {
             for (intT j=0; j < d; j++)
             {
                 intT ngh = vert.getOutNeighbor(j);
-                outEdges[o+j]
-                    = edgeOpFwd( v, j, ngh, vert.getOutWeight(j), f ) ? ngh : -1;
+                if( edgeOpFwd( i, j, ngh, vert.getOutWeight(j), f ) )
+                    next.set(ngh);
             }
         }
         else
         {
-            parallel_for (intT j=0; j < d; j++)
-            {
+            parallel_range( (intT)0, d, 1024, [&]( intT j ) {
                 intT ngh = vert.getOutNeighbor(j);
-                outEdges[o+j]
-                    = edgeOpFwd( v, j, ngh, vert.getOutWeight(j), f ) ? ngh : -1;
+                if( edgeOpFwd( i, j, ngh, vert.getOutWeight(j), f ) )
+                    next.set(ngh);
+            } );
+        }
+    } );
+}
+
+//Whether the dense edgeMap lets each COO partition choose its own
+//traversal (see edgeMapPerPartition)
+template <class vertex>
+inline bool per_partition_direction(partitioned_graph_view<vertex> GA)
+{
+#if PARTITION_DIRECTION
+    return GA.source && GA.has_coo() && GA.has_csc();
+#else
+    return false;
+#endif
+}
+
+//Buffers of edgeMapPerPartition, reused across calls: the statistics of
+//frontiers that were not counted per partition, the partitions pulled
+//through the CSC and the frontier restricted to them
+static frontier_counters partCounters;
+static std::vector<intTpair> partStats;
+static std::vector<char> pullPartition;
+static dense_frontier pullMask;
+static intT pullMaskN = -1;
+static intT pullMaskPartitions = -1;
+
+//Dense edgeMap where each COO partition chooses its own traversal.
+//When partitioning by source, COO partition p holds exactly the out-edges
+//of its vertices, so its active vertices and active edges are known:
+//idle partitions are skipped, lightly active ones push their active
+//vertices (sparse), heavily active ones sweep their edge list (COO), and
+//the remaining ones are pulled together through the CSC with a frontier
+//restricted to their vertices. All results go to one dense frontier.
+//The active vertices and out-degrees of every partition were counted by
+//the edgeMap that wrote the frontier (part_stats); for other frontiers
+//they are counted from the sparse list, or from the dense one.
+template <class F, class vertex, class NT>
+void edgeMapPerPartition(partitioned_graph_view<vertex> GA, const partitioned_vertices & frontier,
+                         F f, NT next, intT threshold)
+{
+    partitioner_view coo_part = GA.get_coo_partitioner();
+    partitioner_view csc_part = GA.get_partition().get_csc_partitioner();
+    graph_view<vertex> WG = GA.get_partition();
+    const dense_frontier & vertices = frontier.d;
+    int coo_partitions = coo_part.get_num_partitions();
+    const intTpair *stats = frontier.part_stats;
+    if( !stats )
+    {
+        partStats.resize(coo_partitions);
+        if( frontier.s )
+        {
+            partCounters.reset(coo_part);
+            parallel_range( (intT)0, frontier.d_m, 2048, [&]( intT k ) {
+                    intT v = frontier.s[k];
+                    partCounters.add(v, WG.V[v].getOutDegree());
+                } );
+            partCounters.partition_totals(partStats.data());
+        }
+        else
+            map_partitionL( coo_part, [&]( int p ) {
+                    partStats[p] = vertices.range_stats(WG.V, coo_part.start_of(p),
+                                                        coo_part.start_of(p+1));
+                } );
+        stats = partStats.data();
+    }
+    pullPartition.resize(coo_partitions);
+    const active_summary & active = denseActive;
+    denseActive.build(vertices, GA.n);
+
+    map_partitionL( coo_part, [&]( int p ) {
+            intT s = coo_part.start_of(p);
+            intT e = coo_part.start_of(p+1);
+            const EdgeList<Edge> & EL = GA.get_edge_list_partition(p);
+            // active vertices and active out-edges of this partition
+            intTpair a = stats[p];
+            // thresholds of edgeMap scaled to the edges of this partition
+            double share = (double)EL.get_num_edges() / (double)GA.m;
+            double work = (double)( a.first + a.second );
+            pullPartition[p] = false;
+            // The counts may predate a transposition, so only partitions
+            // without active vertices are known to be idle
+            if( a.first == 0 )
+                return;
+            if( work > share * (GA.m/2) )
+            {
+#if NUMA_WRITE_CHECK
+                writeCheck.add_coo(coo_part, EL);
+#endif
+                edgeMapDense(EL, vertices, false, f, next, active, GA.source);
             }
+            else if( work <= share * threshold )
+                edgeMapSparseRange(WG, vertices, f, next, s, e);
+            else
+                pullPartition[p] = true;
+        } );
+
+    bool any_pull = false;
+    for( int p=0; p < coo_partitions; ++p )
+        any_pull |= pullPartition[p];
+    if( any_pull )
+    {
+        if( pullMaskN != GA.n || pullMaskPartitions != coo_partitions )
+        {
+            pullMask.del();
+            pullMask.allocate(coo_part);
+            pullMaskN = GA.n;
+            pullMaskPartitions = coo_partitions;
         }
+        map_partitionL( coo_part, [&]( int p ) {
+                intT s = coo_part.start_of(p);
+                intT e = coo_part.start_of(p+1);
+                if( pullPartition[p] )
+                    pullMask.copy_range(vertices, s, e);
+                else
+                    pullMask.clear_range(s, e);
+            } );
+        // CSC ranges do not follow the sources, hence atomic updates
+        map_partitionL( csc_part, [&]( int p ) {
+#if NUMA_WRITE_CHECK
+                writeCheck.add_csc(coo_part, WG, csc_part.start_of(p), csc_part.start_of(p+1));
+#endif
+                edgeMapDenseCSC(WG, pullMask, false, f, next, csc_part.start_of(p), csc_part.start_of(p+1), true);
+            } );
     }
-//Collect the active m of the localfrontier
-        intT* nextIndices = new intT [outEdgeCount];
-        if(remDups) remDuplicates(outEdges,flags,outEdgeCount,remDups);
-        // Filter out the empty slots (marked with -1)
-        uintT nextM = sequence::filter(outEdges,nextIndices,outEdgeCount,nonNegF());
-    delete [] outEdges;
-    delete [] degrees;
-    return pair<uintT,intT*>(nextM, nextIndices);
 }
 
 static int edgesTraversed = 0;
+
+//Dense edgeMap over the dense representation of Localfrontier. work is
+//the number of active vertices plus their out-degrees; the traversal
+//(per partition, COO, CSR push or CSC pull) is chosen from it, option and
+//the partitioning (see forward_dense()), and activated vertices are
+//written to next. DENSE_FORWARD always pushes through the CSR. Only the
+//representations kept resident are used (see resident_t): without the
+//CSC, all traversals go through the COO partitions.
+template <class F, class vertex, class NT>
+void edgeMapDenseAll(partitioned_graph_view<vertex> GA, partitioned_vertices & Localfrontier, F f, NT next, intT threshold, intT work, char option)
+{
+    partitioner_view coo_part = GA.get_coo_partitioner();
+    partitioner_view csc_part = GA.get_partition().get_csc_partitioner();
+    graph_view<vertex> WG = GA.get_partition();
+    intT numVertices = GA.n;
+    // second threshold for dense edgelist/CSC
+    intT denseThreshold = GA.m/2;
+    bool forward = forward_dense<F>(GA, option);
+      if (per_partition_direction(GA) && !Localfrontier.bit && option != DENSE_FORWARD)
+      {
+            edgeMapPerPartition(GA, Localfrontier, f, next, threshold);
+      }
+      else if (GA.has_coo() && (work > denseThreshold || !GA.has_csc())
+          && !(forward && option == DENSE_FORWARD))
+      {
+            // Source ranges with active vertices, to skip idle edge blocks
+            const active_summary & active = denseActive;
+            if( !Localfrontier.bit )
+                denseActive.build(Localfrontier.d, numVertices);
+#if NUMA_WRITE_CHECK
+            map_partitionL( coo_part, [&]( int p ) {
+                    writeCheck.add_coo(coo_part, GA.get_edge_list_partition(p));
+                } );
+#endif
+#if PART96
+            if( !GA.source )
+                map_partitionL( coo_part, [&]( int p ) {
+                        edgeMapDense(GA.get_edge_list_partition(p),Localfrontier.d, Localfrontier.bit, f, next.owned(), active, false);
+                } );
+            else
+#endif
+	    map_partitionL( coo_part, [&]( int p ) {
+                        edgeMapDense(GA.get_edge_list_partition(p),Localfrontier.d, Localfrontier.bit, f, next, active, GA.source);
+                } );
+      }
+      else if (forward)
+      {
+#if CSR_LAZY
+            GA.build_csr();
+#endif
+#if NUMA_WRITE_CHECK
+            map_partitionL( coo_part, [&]( int p ) {
+                    writeCheck.add_csr(coo_part, GA.get_csr_partition(p));
+                } );
+#endif
+            map_partitionL( coo_part, [&]( int p ) {
+                    edgeMapDenseForwardCSR(GA.get_csr_partition(p), Localfrontier.d, Localfrontier.bit, f, next);
+                } );
+      }
+      else
+      {
+#if NUMA_WRITE_CHECK
+	    map_partitionL( csc_part, [&]( int p ) {
+                   writeCheck.add_csc(coo_part, WG, csc_part.start_of(p), csc_part.start_of(p+1));
+                } );
+#endif
+#if PART96
+            // CSC partition p updates the vertices of COO partition p only
+            if( !GA.source )
+	        map_partitionL( csc_part, [&]( int p ) {
+                       edgeMapDenseCSC(WG, Localfrontier.d,Localfrontier.bit,f, next.owned(), csc_part.start_of(p), csc_part.start_of(p+1), false);
+                    } );
+            else
+#endif
+	    map_partitionL( csc_part, [&]( int p ) {
+                   edgeMapDenseCSC(WG, Localfrontier.d,Localfrontier.bit,f, next, csc_part.start_of(p), csc_part.start_of(p+1), GA.source);
+                } );
+       }
+}
+
 template <class F, class vertex>
-partitioned_vertices edgeMap(partitioned_graph<vertex> GA, partitioned_vertices Localfrontier, F f, intT threshold = -1,char option=DENSE, bool remDups=false)
+partitioned_vertices edgeMap(partitioned_graph_view<vertex> GA, partitioned_vertices Localfrontier, F f, intT threshold = -1,char option=DENSE, bool remDups=false)
 {
     timer tm_setup;
     tm_setup.start();
     // this should use data for coo partitions
-    const partitioner &coo_part = GA.get_coo_partitioner();
-    const partitioner &csc_part = GA.get_partition().get_csc_partitioner();
-    graph<vertex> & WG = GA.get_partition();
-    int coo_partitions=coo_part.get_num_partitions();
-    const int coo_perNode = coo_part.get_num_per_node_partitions();
+    partitioner_view coo_part = GA.get_coo_partitioner();
+    graph_view<vertex> WG = GA.get_partition();
     intT numVertices = GA.n;
     // first threshold for dense/sparse
     if(threshold == -1) threshold = GA.m/20; //default threshold
-    // second threshold for dense edgelist/CSC
-    intT denseThreshold = GA.m/2;
 
     intT m = Localfrontier.numNonzeros();
     if (numVertices != Localfrontier.numRows())
@@ -949,43 +1238,36 @@ partitioned_vertices edgeMap(partitioned_graph<vertex> GA, partitioned_vertices
     partitioned_vertices v1;
 
     tmlog( tm_setup, tm_edgemap_setup_ );
-    // Here try to remodify the order of graph traversal
-    if(  m+TotalOutDegrees > threshold)
+    // Here try to remodify the order of graph traversal. Without the
+    // neighbor lists of the whole graph (-mem coo), sparse frontiers are
+    // traversed densely too.
+    if(  m+TotalOutDegrees > threshold || !GA.has_csc())
     {
       Localfrontier.toDense(coo_part);
       v1 = partitioned_vertices::dense(numVertices,coo_part);
-      if (m+TotalOutDegrees > denseThreshold && !GA.part_ver)
-      {
-	    map_partitionL( coo_part, [&]( int p ) {
-                        edgeMapDense(GA.get_edge_list_partition(p),Localfrontier.d, Localfrontier.bit, f, v1.d);
-                } );
-#if 0
-            parallel_for/*_numa*/(int i=0; i < num_numa_node; ++i )   //same loop with allocation
-            {
-                parallel_for( int p = coo_perNode*i; p < coo_perNode*(i+1); ++p )
-                   edgeMapDense(GA.get_edge_list_partition(p),Localfrontier.d, Localfrontier.bit, f, v1.d);
-            }
-            tmlog( tm_setup, tm_edgemap_dense_ );
+      // Activated vertices and their out-degrees are counted while the
+      // kernels write to v1, per COO partition if the next edgeMap
+      // chooses the traversal per partition
+      bool per_partition = per_partition_direction(GA);
+      denseStats.reset(per_partition ? coo_part : partitioner_view());
+#if NUMA_WRITE_CHECK
+      writeCheck.reset();
 #endif
-      }
-      else
-      {
-	    map_partitionL( csc_part, [&]( int p ) {
-                   edgeMapDenseCSC(WG, Localfrontier.d,Localfrontier.bit,f, v1.d, csc_part.start_of(p), csc_part.start_of(p+1), GA.source);
-                } );
-#if 0
-            parallel_for/*_numa*/( int i=0; i < num_numa_node; ++i )   //same loop with allocation
-            {
-                parallel_for( int p = coo_perNode*i; p < coo_perNode*(i+1); ++p )
-                   edgeMapDenseCSC(WG, Localfrontier.d,Localfrontier.bit,f, v1.d, csc_part.start_of(p), csc_part.start_of(p+1), GA.source);
-            }   
+      edgeMapDenseAll(GA, Localfrontier, f,
+                      counting_frontier<vertex>(v1.d, WG.V, denseStats),
+                      threshold, m+TotalOutDegrees, option);
+#if NUMA_WRITE_CHECK
+      writeCheck.report("dense");
 #endif
-       }
-        // Calculate statistics on active vertices and their out-degree
-           intTpair p = sequence::reduce<intT>((intT)0, (intT)GA.n,
-                                            GoutDegree<vertex>(WG, v1.d));
+        // Statistics on active vertices and their out-degree
+           intTpair p = denseStats.total();
            v1.d_m=p.first;
            v1.num_out_edges = p.second;
+           if( per_partition )
+           {
+               v1.part_stats = new intTpair [coo_part.get_num_partitions()];
+               denseStats.partition_totals(v1.part_stats);
+           }
            tmlog( tm_setup, tm_edgemap_dense_bwd_ );
     }
     else    //sparse with sparse output
@@ -996,34 +1278,89 @@ partitioned_vertices edgeMap(partitioned_graph<vertex> GA, partitioned_vertices
         {
             pair<uintT,intT*> R
                 = edgeMapSparseWithG( WG, Localfrontier, m, f,
-                                      remDups, NULL);
+                                      v1.num_out_edges, remDups);
             v1.s = R.second;
             v1.d_m = R.first;
         }
         else
         {
             pair<uintT,intT*> R
-                = edgeMapSparseWithG( WG, Localfrontier, m, f );
+                = edgeMapSparseWithG( WG, Localfrontier, m, f,
+                                      v1.num_out_edges );
             v1.s = R.second;
             v1.d_m = R.first;
         }
 
         tmlog( tm_setup, tm_edgemap_sparse_ );
-
-        if (v1.d_m==0)
-            v1.num_out_edges=0;
-        else
-            v1.num_out_edges = sequence::reduce<intT>((intT)0, v1.d_m, addF<intT>(), GoutDegreeV<vertex>(WG, v1.s));
     }
     return v1;
 }
+
+//The owning graph is passed on as a view, so the call copies no
+//partitioner arrays
+template <class F, class vertex>
+partitioned_vertices edgeMap(partitioned_graph<vertex> & GA, partitioned_vertices Localfrontier, F f, intT threshold = -1,char option=DENSE, bool remDups=false)
+{
+    return edgeMap(partitioned_graph_view<vertex>(GA), Localfrontier, f, threshold, option, remDups);
+}
+
+//edgeMap for algorithms that do not use the returned frontier, such as
+//PageRank, SPMV and BP where all vertices stay active. No output frontier
+//is allocated, written or counted. Small frontiers push their out-edges
+//through the CSR instead of the sparse edgeMap.
+template <class F, class vertex>
+void edgeMapNoOutput(partitioned_graph_view<vertex> GA, partitioned_vertices & Localfrontier, F f, intT threshold = -1)
+{
+    partitioner_view coo_part = GA.get_coo_partitioner();
+    graph_view<vertex> WG = GA.get_partition();
+    if(threshold == -1) threshold = GA.m/20; //default threshold
+
+    intT m = Localfrontier.numNonzeros();
+    if (GA.n != Localfrontier.numRows())
+    {
+        cerr<<"numVertices"<<GA.n<<" and rows"<<Localfrontier.numRows()<<endl;
+        cerr << "edgeMapNoOutput: Sizes Don't match" << endl;
+        abort();
+    }
+
+    intT TotalOutDegrees = Localfrontier.num_out_edges;
+    edgesTraversed += TotalOutDegrees;
+    if(TotalOutDegrees == 0) return;
+
+    Localfrontier.toDense(coo_part);
+    if(  m+TotalOutDegrees > threshold || !GA.has_csc())
+    {
+#if NUMA_WRITE_CHECK
+        writeCheck.reset();
+#endif
+        edgeMapDenseAll(GA, Localfrontier, f, no_frontier(), threshold,
+                        m+TotalOutDegrees, DENSE);
+#if NUMA_WRITE_CHECK
+        writeCheck.report("dense");
+#endif
+    }
+    else
+        map_partitionL( coo_part, [&]( int p ) {
+                intT s = coo_part.start_of(p);
+                intT e = coo_part.start_of(p+1);
+                if( Localfrontier.bit )
+                    edgeMapSparseRange(WG, all_vertices(), f, no_frontier(), s, e);
+                else
+                    edgeMapSparseRange(WG, Localfrontier.d, f, no_frontier(), s, e);
+            } );
+}
+
+template <class F, class vertex>
+void edgeMapNoOutput(partitioned_graph<vertex> & GA, partitioned_vertices & Localfrontier, F f, intT threshold = -1)
+{
+    edgeMapNoOutput(partitioned_graph_view<vertex>(GA), Localfrontier, f, threshold);
+}
 //*****VERTEX FUNCTIONS*****
 //Note: this is the optimized version of vertexMap which does not
 //perform a filter
 template <class F>
-void vertexMap(const partitioner &part, partitioned_vertices V, F add)
+void vertexMap(partitioner_view part, partitioned_vertices V, F add)
 {
-    const int perNode = part.get_num_per_node_partitions();
     // the vertexMap() is called before we call toDense/toSparse, so we
     // should only have one or the other representation, not both.
     if(V.has_dense)
@@ -1041,44 +1378,53 @@ void vertexMap(const partitioner &part, partitioned_vertices V, F add)
     }
     else
     {
-        parallel_for(intT i=0; i<V.d_m; i++)
-        {
+        parallel_range( (intT)0, V.d_m, 1024, [&]( intT i ) {
             add(V.s[i]);
-        }
+        } );
     }
 }
 
 //Note: this is the version of vertexMap in which only a subset of the
 //input partitioned_vertices is returned
 template <typename vertex, class F>
-partitioned_vertices vertexFilter(partitioned_graph<vertex> GA, partitioned_vertices V, F filter)
+partitioned_vertices vertexFilter(partitioned_graph_view<vertex> GA, partitioned_vertices V, F filter)
 {
-    const partitioner &part = GA.get_partitioner();
-    const int perNode = part.get_num_per_node_partitions();
+    partitioner_view part = GA.get_partitioner();
     intT n = V.numRows();
     uintT m = V.numNonzeros();
     
     V.toDense(part);
-    mmap_ptr<bool> d_out;
-    d_out.part_allocate(part);
-    
-    //loop(j,part,perNode,d_out[j]=0);
-    map_vertexL( part, [&](intT j){ d_out[j]=0; } );
+    dense_frontier d_out;
+    d_out.allocate(part);
+
     if (V.bit)
-    {
-       //loop(j,part,perNode,d_out[j]=filter(j));
-       map_vertexL( part, [&](intT j){ d_out[j]=filter(j); } );
-    }
+       d_out.fill( part, [&](intT j){ return (bool)filter(j); } );
     else
+       d_out.fill( part, [&](intT j){ return V.d[j] ? (bool)filter(j) : false; } );
+
+    // Counted per COO partition for edgeMapPerPartition
+    intT np = part.get_num_partitions();
+    intTpair *stats = new intTpair [np];
+    map_partitionL( part, [&]( int p ) {
+            stats[p] = d_out.range_stats(GA.get_partition().V, part.start_of(p),
+                                         part.start_of(p+1));
+        } );
+    intT activeM=0;
+    intT out_edges=0;
+    for( intT p=0; p < np; ++p )
     {
-       //loop(j,part,perNode,if(V.d[j]) d_out[j]=filter(j));
-       map_vertexL( part, [&](intT j){ if (V.d[j]) d_out[j]=filter(j); } );
+        activeM += stats[p].first;
+        out_edges += stats[p].second;
     }
+    partitioned_vertices pv = partitioned_vertices::boolean(n,d_out,activeM,out_edges);
+    pv.part_stats = stats;
+    return pv;
+}
 
-    intTpair p = sequence::reduce<intT>((intT)0, n, GoutDegree<vertex>(GA.get_partition(),d_out));
-    intT activeM=p.first;
-    intT out_edges=p.second;
-    return partitioned_vertices::boolean(n,d_out,activeM,out_edges);
+template <typename vertex, class F>
+partitioned_vertices vertexFilter(partitioned_graph<vertex> & GA, partitioned_vertices V, F filter)
+{
+    return vertexFilter(partitioned_graph_view<vertex>(GA), V, filter);
 }
 
 
@@ -1100,11 +1446,14 @@ int parallel_main(int argc, char* argv[])
     bool binary = P.getOptionValue("-b");             //Galois binary format
     long start = P.getOptionLongValue("-r",100);      //start vertex for BFS,BC and BellmanFord
     long rounds = P.getOptionLongValue("-rounds",3); // Usually 20 rounds
-    int numOfNode = P.getOptionLongValue("-p", 4);    // NUMA node number
+    int numOfNode = P.getOptionLongValue("-p", 0);    // NUMA node number, 0: all nodes of the cpuset
     int numOfCoo = P.getOptionLongValue("-c", 384);   // Partition number for COO
     char *part_how = P.getOptionValue("-P");          // Parition method, default is partition by destination
     char *vertex_edge = P.getOptionValue("-v");       // vertex/edge oriented, default is edge
     bool relabel = P.getOptionValue("-o");            // original/relabel graph, if -o, uses relabel graph 
+    char *snap = P.getOptionValue("-snap");           // snapshot of the partitioned graph, see snapshot.h
+    bool stream = P.getOptionValue("-stream");       // read Galois edges while partitioning, see stream_load.h
+    char *mem = P.getOptionValue("-mem");             // representations kept after partitioning, default is all
     bool part_src = true;
     bool part_vertex = true;
     if( !part_how || !strcmp( part_how, "dest" ) )
@@ -1118,6 +1467,20 @@ int parallel_main(int argc, char* argv[])
         return 1;
     }
 
+    resident_t resident;
+    if( !mem || !strcmp( mem, "all" ) )
+        resident = RESIDENT_ALL;
+    else if( !strcmp( mem, "csc" ) )
+        resident = RESIDENT_CSC;
+    else if( !strcmp( mem, "coo" ) )
+        resident = RESIDENT_COO;
+    else
+    {
+        std::cerr << "Illegal value for -mem: \"" << mem
+                  << "\". Allowed values: all csc coo. Default: all\n";
+        return 1;
+    }
+
     if( !vertex_edge|| !strcmp( vertex_edge, "edge" ) )
         part_vertex = false;
     else if( !strcmp( vertex_edge, "vertex" ) )
@@ -1129,19 +1492,33 @@ int parallel_main(int argc, char* argv[])
         return 1;
     }
 
-#ifndef __APPLE__
-    if( numOfNode == 0 )
-        numOfNode = numa_num_configured_nodes();
-#else
-    if( numOfNode == 0 )
-        numOfNode = 1;
-    cerr << "numOfNode: " << numOfNode << endl;
+#if NUMA
+    // Before any partitioner is built: they place partitions on these nodes
+    num_numa_node = numa_nodes::get().restrict_to( numOfNode );
+#if !defined(NUMA_SCHED) && !defined(OPENMP)
+    // The Cilk runtime runs partition k on its own k-th node, while
+    // memory is bound to the physical node id(k)
+    if( !numa_nodes::get().leading() )
+    {
+        std::cerr << "The Cilk build only runs on NUMA nodes 0.."
+                  << num_numa_node-1 << ", but the cpuset uses nodes";
+        for( int k=0; k < num_numa_node; ++k )
+            std::cerr << ' ' << numa_nodes::get().id( k );
+        std::cerr << ". Build with SCHED=numa_sched or SCHED=openmp.\n";
+        return 1;
+    }
+#endif
 #endif
     if(symmetric)
     {
         wholeGraph<symmetricVertex> G =
-            readGraph<symmetricVertex>(iFile,symmetric,binary); //symmetric graph
-        partitioned_graph<symmetricVertex> PG( G, numOfCoo, part_src, part_vertex,relabel);
+            readGraph<symmetricVertex>(iFile,symmetric,binary,stream); //symmetric graph
+        partitioned_graph<symmetricVertex> PG( G, numOfCoo, part_src, part_vertex,relabel,snap);
+#if CSC_LOCAL
+        G.del_in_edges();   // the neighbor lists now live in PG
+#endif
+        if( PG.release( resident ) == RESIDENT_COO )
+            G.del_edges();  // only the COO partitions are used
         intT n = G.n;
 
 #if PAPI_CACHE 
@@ -1171,9 +1548,14 @@ int parallel_main(int argc, char* argv[])
         load.start();
         cerr<<"Loading Graph "<<endl;
         wholeGraph<asymmetricVertex> G =
-            readGraph<asymmetricVertex>(iFile,symmetric,binary); //asymmetric graph
+            readGraph<asymmetricVertex>(iFile,symmetric,binary,stream); //asymmetric graph
         cerr<<"Loading: "<<tmlog(load,load_t)<<endl;
-        partitioned_graph<asymmetricVertex> PG( G, numOfCoo, part_src, part_vertex,relabel);
+        partitioned_graph<asymmetricVertex> PG( G, numOfCoo, part_src, part_vertex,relabel,snap);
+#if CSC_LOCAL
+        G.del_in_edges();   // the in-edges now live in PG
+#endif
+        if( PG.release( resident ) == RESIDENT_COO )
+            G.del_edges();  // only the COO partitions are used
         if(PG.transposed()) PG.transpose();
 
         intT n = G.n;
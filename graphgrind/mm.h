@@ -57,7 +57,7 @@ public:
         local_allocate(elements,numa_node);
     }
 
-    void part_allocate(const partitioner &part)
+    void part_allocate(partitioner_view part)
     {
         //timer part_alloc;
        // part_alloc.start();
@@ -80,13 +80,11 @@ public:
         // cout << "mmap: mem=" << mem << " size=" << totalSize << "\n";
 	//For frontier and algorithm data array, if not use 
 	//NUMA aware allocation, not use mbind, only mmap       
-        const int partNum = part.get_num_partitions();
-        const int perNode = part.get_num_per_node_partitions();
         intptr_t pmem = reinterpret_cast<intptr_t>(mem);
         //Try to do the vector special allocation
         for ( int p =0 ; p < num_numa_node; ++p)
         {
-            for( int i = perNode*p; i < perNode*(p+1); ++i )
+            for( int i = part.node_start(p); i < part.node_start(p+1); ++i )
             { 
                 //This function use too many time during huge array 
                 //to do special allocation use the mbind()
@@ -107,6 +105,43 @@ public:
        //mmap_alloc+=part_alloc.next();
     }
 
+    // As part_allocate(), but every element of T holds per_elem vertices
+    // (e.g. 64 frontier bits per word). Partition boundaries are expected
+    // to be multiples of per_elem so that no element straddles two nodes.
+    void part_allocate_packed(partitioner_view part, intT per_elem)
+    {
+        if( totalSize !=0 || mem != 0 )
+        {
+            cerr<<"partitioner already allocated"<<'\n';
+            abort();
+        }
+        const intT elements = (part.get_num_elements()+per_elem-1)/per_elem;
+        totalSize = elements*sizeof(T);
+        if((totalSize % page_size) !=0)
+        {
+           totalSize = (((totalSize+page_size-1)/ page_size)) * page_size;
+        }
+        mem = mmap( 0, totalSize, PROTECTED, FLAGS ,0, 0);
+        if( mem == (void *)-1 || mem ==(void *)0 )
+        {
+            std::cerr << "part mmap failed: " << strerror(errno) << ", size " << totalSize << '\n';
+            exit(1);
+        }
+        intptr_t pmem = reinterpret_cast<intptr_t>(mem);
+        for ( int p =0 ; p < num_numa_node; ++p)
+        {
+            for( int i = part.node_start(p); i < part.node_start(p+1); ++i )
+            {
+                intT s = (part.start_of(i)+per_elem-1)/per_elem;
+                intT e = (part.start_of(i+1)+per_elem-1)/per_elem;
+                size_t size = (e-s)*sizeof(T);
+                intptr_t pmem_rounded = round_page(pmem,small_size,size);
+                bind_pages(reinterpret_cast<void*>(pmem_rounded),size,mflag,p);
+                pmem += (e-s)*sizeof(T);
+            }
+        }
+    }
+
     void Interleave_allocate(size_t elements)
     {
         if( totalSize!=0 ||mem != 0 )
@@ -136,6 +171,8 @@ public:
             cerr<<"local NUMA already allocated\n";
             abort();
         }
+        if( elements == 0 )
+            return; // e.g. a partition without edges
         totalSize = elements*sizeof(T);
         if((totalSize % page_size) !=0)
         {
@@ -165,11 +202,12 @@ private:
         return ret;
     }
 
+    // numa_node is numbered as in numa_nodes.h
     void bind_pages(void * mem, size_t size,int policy, int numa_node)
     {
         struct bitmask *bmp;
         bmp = numa_allocate_nodemask();
-        numa_bitmask_setbit(bmp, numa_node);
+        numa_bitmask_setbit(bmp, numa_nodes::get().id(numa_node));
         if (mem == (void *)-1)
             mem = NULL;
         else
@@ -181,7 +219,8 @@ private:
     {
         struct bitmask *bmp;
         bmp = numa_allocate_nodemask();
-        numa_bitmask_setall(bmp);
+        for( int k=0; k < num_numa_node; ++k )
+            numa_bitmask_setbit(bmp, numa_nodes::get().id(k));
         if (mem == (void *)-1)
             mem = NULL;
         else
@@ -273,11 +312,16 @@ public:
         local_allocate(elements,numa_node);
     }
 
-    void part_allocate(const partitioner &part)
+    void part_allocate(partitioner_view part)
     {
         mem = new T[part.get_num_elements()];
     }
 
+    void part_allocate_packed(partitioner_view part, intT per_elem)
+    {
+        mem = new T[(part.get_num_elements()+per_elem-1)/per_elem];
+    }
+
     void Interleave_allocate(size_t elements)
     {
         mem = new T[elements];
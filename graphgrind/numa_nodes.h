@@ -0,0 +1,168 @@
+// -*- C++ -*-
+// NUMA nodes used by GraphGrind and the placement of partitions on them.
+//
+// Only nodes holding CPUs of the process cpuset (sched_getaffinity) and
+// memory the process may allocate on are used, so a job started under
+// numactl, taskset or a cgroup on part of the machine keeps its
+// partitions, memory and threads there. The -p option can limit the
+// number of nodes further (restrict_to()).
+//
+// The nodes used are numbered 0..count()-1 in order of their physical
+// id; id() gives the physical id for mbind() and numa_node_to_cpus().
+// Work is shared out in proportion to the CPUs each node has in the
+// cpuset (share()), with at least one item per node when there are as
+// many items as nodes.
+#ifndef NUMA_NODES_H
+#define NUMA_NODES_H
+
+#include <vector>
+#include <algorithm>
+#include <sched.h>
+#if NUMA
+#include <numa.h>
+#endif
+
+namespace numa_nodes
+{
+
+class topology
+{
+    std::vector<int> ids;         // physical node id
+    std::vector<cpu_set_t> cpus;  // CPUs of the cpuset on the node
+    std::vector<long> cum_cpus;   // CPUs on the nodes before each node
+
+    void add( int id, const cpu_set_t & set )
+    {
+        ids.push_back( id );
+        cpus.push_back( set );
+    }
+
+    void count_cpus()
+    {
+        cum_cpus.assign( ids.size()+1, 0 );
+        for( size_t k=0; k < ids.size(); ++k )
+            cum_cpus[k+1] = cum_cpus[k] + CPU_COUNT( &cpus[k] );
+    }
+
+    void detect()
+    {
+        cpu_set_t allowed;
+        CPU_ZERO( &allowed );
+        if( sched_getaffinity( 0, sizeof( allowed ), &allowed ) != 0 )
+            for( int c=0; c < CPU_SETSIZE; ++c )
+                CPU_SET( c, &allowed );
+#if NUMA
+        if( numa_available() >= 0 )
+        {
+            struct bitmask *node_cpus = numa_allocate_cpumask();
+            struct bitmask *mems = numa_get_mems_allowed();
+            for( int n=0; n <= numa_max_node(); ++n )
+            {
+                if( !numa_bitmask_isbitset( mems, n )
+                    || numa_node_to_cpus( n, node_cpus ) != 0 )
+                    continue;
+                cpu_set_t set;
+                CPU_ZERO( &set );
+                for( unsigned c=0; c < node_cpus->size && c < CPU_SETSIZE; ++c )
+                    if( numa_bitmask_isbitset( node_cpus, c )
+                        && CPU_ISSET( c, &allowed ) )
+                        CPU_SET( c, &set );
+                if( CPU_COUNT( &set ) > 0 )
+                    add( n, set );
+            }
+            numa_free_nodemask( mems );
+            numa_free_cpumask( node_cpus );
+        }
+#endif
+        // No NUMA support, or no node matches the cpuset
+        if( ids.empty() )
+        {
+            if( CPU_COUNT( &allowed ) == 0 )
+                CPU_SET( 0, &allowed );
+            add( 0, allowed );
+        }
+        count_cpus();
+    }
+
+public:
+    topology()
+    {
+        detect();
+    }
+
+    int count() const
+    {
+        return ids.size();
+    }
+    // Physical id of node k
+    int id( int k ) const
+    {
+        return ids[k];
+    }
+    const cpu_set_t & cpuset( int k ) const
+    {
+        return cpus[k];
+    }
+    long num_cpus() const
+    {
+        return cum_cpus.back();
+    }
+    // Node holding CPU cpu, -1 if none of the nodes used
+    int node_of_cpu( int cpu ) const
+    {
+        for( int k=0; k < count(); ++k )
+            if( cpu >= 0 && cpu < CPU_SETSIZE && CPU_ISSET( cpu, &cpus[k] ) )
+                return k;
+        return -1;
+    }
+
+    // Whether the nodes used are the physical nodes 0..count()-1
+    bool leading() const
+    {
+        for( int k=0; k < count(); ++k )
+            if( ids[k] != k )
+                return false;
+        return true;
+    }
+
+    // Use the first p nodes only (all when p is 0 or too large)
+    int restrict_to( int p )
+    {
+        if( p > 0 && p < count() )
+        {
+            ids.resize( p );
+            cpus.resize( p );
+            count_cpus();
+        }
+        return count();
+    }
+
+    // Out of n items, node k takes [share(k,n), share(k+1,n)): one item
+    // per node, the remainder in proportion to the CPUs of the nodes.
+    // With fewer items than nodes, the first n nodes take one each.
+    long share( int k, long n ) const
+    {
+        long nodes = count();
+        if( n < nodes )
+            return std::min( (long)k, n );
+        return k + ( n - nodes ) * cum_cpus[k] / num_cpus();
+    }
+    // Node taking item i out of n
+    int owner( long i, long n ) const
+    {
+        int k = 0;
+        while( k+1 < count() && share( k+1, n ) <= i )
+            ++k;
+        return k;
+    }
+};
+
+inline topology & get()
+{
+    static topology t;
+    return t;
+}
+
+} // namespace numa_nodes
+
+#endif // NUMA_NODES_H
@@ -0,0 +1,311 @@
+// -*- C++ -*-
+// Portable NUMA-aware work-stealing scheduler built on std::thread.
+//
+// Selected with NUMA_SCHED=1 instead of Cilk (see parallel.h). It backs
+// map_partitionL(), map_vertexL() and map_partition() in partitioner.h,
+// so builds no longer depend on __cilkrts_cilk_for_numa_64 from the
+// prebuilt cilk-swan runtime nor on a compiler with Cilk Plus.
+//
+// There is one worker per CPU of the process cpuset (or
+// NUMA_SCHED_WORKERS). The workers are shared out over the NUMA nodes of
+// numa_nodes.h in proportion to their CPUs and pinned to the CPUs of
+// their node in the cpuset. Every node has its own task deque: workers take the most
+// recent task of their own node and only steal the oldest task of another
+// node when their node has no work left. A task covers a range of indices
+// and splits itself in halves while it is larger than its grain, pushing
+// the upper halves to its node's deque, so that one task per partition
+// is enough to balance the work within the node.
+//
+// The thread calling map_*() is worker 0. It waits for its tasks by
+// executing tasks itself, so nested calls from within a task are allowed.
+// Loops run on the scheduler through parallel_range() (see parallel.h):
+// parallel_for itself remains a plain loop, as a for statement cannot be
+// turned into a task without rewriting it.
+#ifndef NUMA_SCHED_H
+#define NUMA_SCHED_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <stdlib.h>
+#include <sched.h>
+#include "numa_nodes.h"
+
+// Number of indices below which a task is not split further
+#ifndef NUMA_SCHED_GRAIN
+#define NUMA_SCHED_GRAIN 2048
+#endif
+
+// parallel_range() splits a loop in at most this many tasks per worker
+#ifndef NUMA_SCHED_RANGE_TASKS
+#define NUMA_SCHED_RANGE_TASKS 8
+#endif
+
+namespace numa_sched
+{
+
+struct task
+{
+    void (*fn)( void *data, long lo, long hi );
+    void *data;
+    long lo, hi, grain;
+    int node;
+    std::atomic<long> *pending;
+};
+
+class scheduler
+{
+    struct node_queue
+    {
+        std::mutex lock;
+        std::deque<task> tasks;
+        char pad[64];   // keep nodes on separate cache lines
+    };
+
+    int num_workers;
+    int num_nodes;
+    node_queue *queues;
+    std::vector<std::thread> threads;
+    std::atomic<long> queued;
+    std::atomic<bool> stop;
+    std::atomic<int> sleeping;  // workers waiting on wakeup
+    std::mutex sleep_lock;
+    std::condition_variable wakeup;
+
+    static int & my_id()
+    {
+        static thread_local int id = 0;
+        return id;
+    }
+
+    int node_of_worker( int w ) const
+    {
+        return numa_nodes::get().owner( w, num_workers );
+    }
+
+    static void pin_to_node( int node )
+    {
+        const cpu_set_t &set = numa_nodes::get().cpuset( node );
+        sched_setaffinity( 0, sizeof( set ), &set );
+    }
+
+    // Most recent task of the own node, else the oldest task of the
+    // closest node (by index) that has one
+    bool find_task( int node, task & t )
+    {
+        for( int k=0; k < num_nodes; ++k )
+        {
+            node_queue &q = queues[( node + k ) % num_nodes];
+            std::lock_guard<std::mutex> g( q.lock );
+            if( q.tasks.empty() )
+                continue;
+            if( k == 0 )
+            {
+                t = q.tasks.back();
+                q.tasks.pop_back();
+            }
+            else
+            {
+                t = q.tasks.front();
+                q.tasks.pop_front();
+            }
+            --queued;
+            return true;
+        }
+        return false;
+    }
+
+    void execute( task t )
+    {
+        while( t.hi - t.lo > t.grain )
+        {
+            long mid = t.lo + ( t.hi - t.lo ) / 2;
+            task r = t;
+            r.lo = mid;
+            ++*t.pending;
+            push( r );
+            t.hi = mid;
+        }
+        t.fn( t.data, t.lo, t.hi );
+        t.pending->fetch_sub( 1, std::memory_order_release );
+    }
+
+    void worker_loop( int id )
+    {
+        my_id() = id;
+        int node = node_of_worker( id );
+        pin_to_node( node );
+        task t;
+        while( !stop.load() )
+        {
+            if( find_task( node, t ) )
+            {
+                execute( t );
+                continue;
+            }
+            std::unique_lock<std::mutex> g( sleep_lock );
+            ++sleeping;
+            wakeup.wait( g, [&]{ return stop.load() || queued.load() > 0; } );
+            --sleeping;
+        }
+    }
+
+public:
+    scheduler() : queued( 0 ), stop( false ), sleeping( 0 )
+    {
+        num_nodes = numa_nodes::get().count();
+        num_workers = numa_nodes::get().num_cpus();
+        if( const char *env = getenv( "NUMA_SCHED_WORKERS" ) )
+            num_workers = std::max( 1, atoi( env ) );
+        num_nodes = std::min( num_nodes, num_workers );
+        queues = new node_queue [num_nodes];
+        for( int w=1; w < num_workers; ++w )
+            threads.push_back( std::thread( &scheduler::worker_loop, this, w ) );
+    }
+    ~scheduler()
+    {
+        {
+            std::lock_guard<std::mutex> g( sleep_lock );
+            stop = true;
+        }
+        wakeup.notify_all();
+        for( size_t i=0; i < threads.size(); ++i )
+            threads[i].join();
+        delete [] queues;
+    }
+
+    int get_num_workers() const
+    {
+        return num_workers;
+    }
+    int get_num_nodes() const
+    {
+        return num_nodes;
+    }
+    int get_worker_id() const
+    {
+        return my_id();
+    }
+    int get_worker_node() const
+    {
+        return node_of_worker( my_id() );
+    }
+
+    void push( const task & t )
+    {
+        node_queue &q = queues[t.node % num_nodes];
+        {
+            std::lock_guard<std::mutex> g( q.lock );
+            q.tasks.push_back( t );
+        }
+        // A worker going to sleep counts itself before it tests queued,
+        // and both are sequentially consistent, so either it sees the
+        // task or it is seen here
+        ++queued;
+        if( sleeping.load() > 0 )
+        {
+            std::lock_guard<std::mutex> g( sleep_lock );
+            wakeup.notify_one();
+        }
+    }
+
+    // Execute tasks until all tasks counted by pending have completed
+    void wait( std::atomic<long> & pending )
+    {
+        int node = node_of_worker( my_id() );
+        task t;
+        while( pending.load( std::memory_order_acquire ) > 0 )
+        {
+            if( find_task( node, t ) )
+                execute( t );
+            else
+                std::this_thread::yield();
+        }
+    }
+};
+
+inline scheduler & get()
+{
+    static scheduler s;
+    return s;
+}
+
+inline int num_workers()
+{
+    return get().get_num_workers();
+}
+inline int worker_id()
+{
+    return get().get_worker_id();
+}
+
+// A set of ranges executed in parallel: spawn() queues body(lo,hi) over
+// [lo,hi) on the deque of node, wait() returns when all have completed.
+template<class Body>
+class range_batch
+{
+    Body & body;
+    std::atomic<long> pending;
+
+    static void call( void *data, long lo, long hi )
+    {
+        reinterpret_cast<range_batch<Body> *>( data )->body( lo, hi );
+    }
+public:
+    range_batch( Body & body_ ) : body( body_ ), pending( 0 ) { }
+
+    void spawn( int node, long lo, long hi, long grain )
+    {
+        if( lo >= hi )
+            return;
+        task t;
+        t.fn = &call;
+        t.data = reinterpret_cast<void *>( this );
+        t.lo = lo;
+        t.hi = hi;
+        t.grain = std::max( grain, 1l );
+        t.node = node;
+        t.pending = &pending;
+        ++pending;
+        get().push( t );
+    }
+    void wait()
+    {
+        get().wait( pending );
+    }
+};
+
+// body(i) for every i in [lo,hi). The range is queued on the node of the
+// calling worker, in tasks of at least grain indices (and at most
+// NUMA_SCHED_RANGE_TASKS per worker); the other nodes steal from it when
+// idle. Small ranges and single worker runs are plain loops.
+template<class I, class Body>
+void parallel_range( I lo, I hi, long grain, Body body )
+{
+    if( !( lo < hi ) )
+        return;
+    long n = (long)( hi - lo );
+    scheduler &s = get();
+    grain = std::max( grain, n / ( NUMA_SCHED_RANGE_TASKS * s.get_num_workers() ) );
+    if( n <= grain || s.get_num_workers() == 1 )
+    {
+        for( I i=lo; i < hi; ++i )
+            body( i );
+        return;
+    }
+    auto chunk = [&]( long a, long b ) {
+        for( I i=lo+(I)a, e=lo+(I)b; i < e; ++i )
+            body( i );
+    };
+    range_batch<decltype(chunk)> batch( chunk );
+    batch.spawn( s.get_worker_node(), 0, n, grain );
+    batch.wait();
+}
+
+} // namespace numa_sched
+
+#endif // NUMA_SCHED_H
@@ -55,6 +55,18 @@
 #define parallel_for_1 _Pragma("omp parallel for schedule (static,1)") for
 #define parallel_for_256 _Pragma("omp parallel for schedule (static,256)") for
 
+// std::thread work-stealing scheduler for the partition and vertex maps
+// and parallel_range() (numa_sched.h). parallel_for is a plain loop.
+#elif defined(NUMA_SCHED)
+#include "numa_sched.h"
+#define cilk_spawn
+#define cilk_sync
+#define parallel_main main
+#define parallel_for for
+#define parallel_for_1 for
+#define parallel_for_256 for
+#define cilk_for for
+
 // c++
 #else
 #define cilk_spawn
@@ -105,3 +117,31 @@ typedef unsigned int uintE;
 #define UINT_E_MAX UINT_MAX
 #endif
 
+// parallel.h has no include guard, so guard the definition.
+#ifndef PARALLEL_RANGE_DEFINED
+#define PARALLEL_RANGE_DEFINED
+// parallel_range( lo, hi, grain, body ): body(i) for every i in [lo,hi),
+// in parallel. grain is the smallest number of indices per task: the
+// cilk_for grainsize, the OpenMP dynamic chunk. Loops written this way
+// also run in parallel with NUMA_SCHED, where parallel_for is a plain loop.
+#if defined(NUMA_SCHED)
+using numa_sched::parallel_range;
+#else
+template<class I, class Body>
+inline void parallel_range( I lo, I hi, long grain, Body body )
+{
+#if defined(CILK) || defined(CILKP)
+    _Pragma( STRINGIFY(cilk grainsize = grain) ) cilk_for(
+        I i=lo; i < hi; ++i )
+        body( i );
+#elif defined(OPENMP)
+    _Pragma( STRINGIFY(omp parallel for schedule( dynamic, grain )) ) for(
+        I i=lo; i < hi; ++i )
+        body( i );
+#else
+    for( I i=lo; i < hi; ++i )
+        body( i );
+#endif
+}
+#endif
+#endif // PARALLEL_RANGE_DEFINED
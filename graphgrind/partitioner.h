@@ -3,6 +3,7 @@
 #include <fstream>
 #include <stdlib.h>
 #include "parallel.h"
+#include "numa_nodes.h"
 #include <assert.h>
 #include <unistd.h>
 #include <sched.h>
@@ -10,12 +11,17 @@
 #include <cstring>
 #include <utility>
 #include <algorithm>
+#if defined(CILK) || defined(CILKP)
 #include <cilk/cilk.h>
+#endif
 
 #if NUMA
 #include <numa.h>
 #include <numaif.h>
-static int num_numa_node=numa_num_configured_nodes();
+// Nodes of the process cpuset, see numa_nodes.h. Updated by
+// parallel_main() when -p restricts the number of nodes.
+static int num_numa_node=numa_nodes::get().count();
+#if !defined(NUMA_SCHED) && !defined(OPENMP)
 // Copied from Cilk include/internal/abi.h:
 typedef uint64_t cilk64_t;
 typedef void (*__cilk_abi_f64_t)(void *data, cilk64_t low, cilk64_t high);
@@ -24,6 +30,7 @@ extern "C" {
     void __cilkrts_cilk_for_numa_64(__cilk_abi_f64_t body, void *data,
 				    cilk64_t count, int grain);
 }
+#endif // !NUMA_SCHED && !OPENMP
 
 #else
 static int num_numa_node = 1;
@@ -37,20 +44,20 @@ static int num_numa_node = 1;
 #if PARTITION_RANGE
 class partitioner
 {
+    friend class partitioner_view;
     intT num_partitions;
     intT * partition;
 #if CPU_PARTITION
     intT * vstarts;
 #endif
     intT * starts;
-    int num_per_node;
 public:
     // Deep copy semantics: every copy gets a new array
-    partitioner() : num_partitions( 0 ), partition( 0 ), starts( 0 ), 
+    partitioner() : num_partitions( 0 ), partition( 0 ),
 #if CPU_PARTITION
 vstarts ( 0 ), 
 #endif
-num_per_node(0) { }
+starts( 0 ) { }
     partitioner( intT n, intT e ) : num_partitions( n )
     {
         partition = new intT [num_partitions+1];
@@ -59,7 +66,6 @@ num_per_node(0) { }
         vstarts = new intT [num_partitions+1];
 #endif
         partition[num_partitions] = e;
-        num_per_node = num_partitions/num_numa_node;
     }
     partitioner( const partitioner & p ) : num_partitions( p.num_partitions )
     {
@@ -71,7 +77,6 @@ num_per_node(0) { }
         vstarts = new intT [num_partitions+1];
         std::copy( &p.vstarts[0], &p.vstarts[num_partitions+1], vstarts );
 #endif
-        num_per_node = num_partitions/num_numa_node;
     }
     const partitioner & operator = ( const partitioner & p )
     {
@@ -84,7 +89,6 @@ num_per_node(0) { }
             delete [] vstarts;
 #endif
         num_partitions = p.num_partitions;
-        num_per_node = p.num_partitions/num_numa_node;
         partition = new intT [num_partitions+1];
         starts = new intT [num_partitions+1];
         std::copy( &p.partition[0], &p.partition[num_partitions+1], partition );
@@ -112,9 +116,15 @@ num_per_node(0) { }
     {
         return partition;
     }
-    int get_num_per_node_partitions() const
+    // Partitions [node_start(k), node_start(k+1)) are placed on NUMA
+    // node k (numbered as in numa_nodes.h)
+    intT node_start( int k ) const
+    {
+        return numa_nodes::get().share( k, num_partitions );
+    }
+    int node_of( intT p ) const
     {
-        return num_per_node;
+        return numa_nodes::get().owner( p, num_partitions );
     }
 
     int get_num_partitions() const
@@ -149,6 +159,24 @@ num_per_node(0) { }
         return partition[i];
     }
 
+    // Move every partition boundary up to a multiple of align elements,
+    // so that data packed per align elements (e.g. frontier bitmaps) is
+    // never shared by two partitions. Partitions may become empty on very
+    // small inputs. Call before compute_starts().
+    void align_boundaries( intT align )
+    {
+        intT n = partition[num_partitions];
+        intT end = 0, prev = 0;
+        for( intT p=0; p < num_partitions-1; ++p )
+        {
+            end += partition[p];
+            intT bnd = std::min( ((end+align-1)/align)*align, n );
+            partition[p] = bnd - prev;
+            prev = bnd;
+        }
+        partition[num_partitions-1] = n - prev;
+    }
+
     //get the start number of each partition
     void compute_starts()
     {
@@ -198,6 +226,59 @@ num_per_node(0) { }
         iterator end() const { return &partition;}
     */
 };
+
+// Non-owning view of a partitioner: the same read-only interface, but
+// trivially copyable, so it can be passed by value on hot paths without
+// the allocations of the partitioner's deep copies. It is valid as long
+// as the partitioner lives and its boundaries do not change. Partitioners
+// convert implicitly, so functions taking a view accept both.
+class partitioner_view
+{
+    intT num_partitions;
+    const intT * partition;
+    const intT * starts;
+public:
+    partitioner_view() : num_partitions( 0 ), partition( 0 ), starts( 0 ) { }
+    partitioner_view( const partitioner & p )
+        : num_partitions( p.num_partitions ),
+          partition( p.partition ), starts( p.starts ) { }
+
+    intT node_start( int k ) const
+    {
+        return numa_nodes::get().share( k, num_partitions );
+    }
+    int node_of( intT p ) const
+    {
+        return numa_nodes::get().owner( p, num_partitions );
+    }
+    int get_num_partitions() const
+    {
+        return num_partitions;
+    }
+    intT get_num_elements() const
+    {
+        return partition[num_partitions];
+    }
+    intT partition_of( intT vertex_id ) const
+    {
+        intT p = std::upper_bound( &starts[0], &starts[num_partitions],
+                                   vertex_id ) - starts - 1;
+        assert( 0 <= p && p < num_partitions );
+        return p;
+    }
+    intT get_size(intT i) const
+    {
+        return partition[i];
+    }
+    intT start_of(intT i) const
+    {
+        return starts[i];
+    }
+    intT offset_of( intT vertex_id ) const
+    {
+        return vertex_id - starts[partition_of( vertex_id )];
+    }
+};
 #else
 class partitioner
 {
@@ -277,6 +358,9 @@ public:
         return size[i];
     }
 };
+
+// Views are only provided for partitioning by ranges
+typedef partitioner partitioner_view;
 #endif
 
 struct IsPart
@@ -294,33 +378,33 @@ struct IsPart
 
 template<typename Fn>
 struct PartitionOp {
-    const partitioner & part;
+    partitioner_view part;
     Fn data;
 
-    PartitionOp( const partitioner & part_, Fn data_ )
+    PartitionOp( partitioner_view part_, Fn data_ )
 	: part( part_ ), data( data_ ) { }
 
     static void func(void *data, uint64_t low, uint64_t high) {
 	PartitionOp<Fn> * datap = reinterpret_cast<PartitionOp<Fn> *>( data );
-	intT perNode = datap->part.get_num_per_node_partitions();
-	parallel_for( uint64_t n=low*perNode; n < high*perNode; ++n )
+	intT ps = datap->part.node_start( low );
+	intT pe = datap->part.node_start( high );
+	parallel_for( intT n=ps; n < pe; ++n )
 	    datap->data( n );
     }
 };
 
 template<typename Fn>
 struct VertexOp {
-    const partitioner & part;
+    partitioner_view part;
     Fn data;
 
-    VertexOp( const partitioner & part_, Fn data_ )
+    VertexOp( partitioner_view part_, Fn data_ )
 	: part( part_ ), data( data_ ) { }
 
     static void func(void *data, uint64_t low, uint64_t high) {
 	VertexOp<Fn> * datap = reinterpret_cast<VertexOp<Fn> *>( data );
-	intT perNode = datap->part.get_num_per_node_partitions();
-	intT ps = datap->part.start_of( low * perNode );
-	intT pe = datap->part.start_of( high * perNode );
+	intT ps = datap->part.start_of( datap->part.node_start( low ) );
+	intT pe = datap->part.start_of( datap->part.node_start( high ) );
 #if defined(CILK)
 	_Pragma( STRINGIFY(cilk grainsize = _SCAN_BSIZE) ) parallel_for(
 	    intT v=ps; v < pe; ++v )
@@ -333,9 +417,102 @@ struct VertexOp {
 };
 
 
+#if defined(NUMA_SCHED)
+// One task per partition, queued on the node holding the partition
+template<typename Fn>
+void map_partitionL( partitioner_view part, Fn fn ) {
+    auto body = [&]( long lo, long hi ) {
+	for( long p=lo; p < hi; ++p )
+	    fn( p );
+    };
+    numa_sched::range_batch<decltype(body)> batch( body );
+    intT np = part.get_num_partitions();
+    for( intT p=0; p < np; ++p )
+	batch.spawn( part.node_of( p ), p, p+1, 1 );
+    batch.wait();
+}
+#define map_partition(vname,part,code)					\
+    {									\
+	map_partitionL( part, [&]( int vname ) { code } );		\
+    }
+
+// The vertices of each partition are split on the node holding them
+template<typename Fn>
+void map_vertexL( partitioner_view part, Fn fn ) {
+    auto body = [&]( long lo, long hi ) {
+	for( long v=lo; v < hi; ++v )
+	    fn( v );
+    };
+    numa_sched::range_batch<decltype(body)> batch( body );
+    intT np = part.get_num_partitions();
+    for( intT p=0; p < np; ++p )
+	batch.spawn( part.node_of( p ), part.start_of( p ),
+		     part.start_of( p+1 ), NUMA_SCHED_GRAIN );
+    batch.wait();
+}
+
+#elif defined(OPENMP) && NUMA
+// OpenMP equivalent of the Cilk NUMA loops: an outer team with one thread
+// per NUMA node, spread over the places, each starting a nested team on
+// its own place for the partitions of its node. Run with
+// OMP_PLACES=sockets (or numa_domains) so that the places are the nodes.
+// The threads at startup (OMP_NUM_THREADS) are shared out over the nodes
+// like partitions, in proportion to the CPUs of the nodes: node k has
+// threads [omp_node_thread(k), omp_node_thread(k+1)).
+static int omp_max_threads = omp_get_max_threads();
+
+inline int omp_num_threads() {
+    return std::max( omp_max_threads, num_numa_node );
+}
+inline int omp_node_thread( int k ) {
+    return numa_nodes::get().share( k, omp_num_threads() );
+}
+
+template<typename Fn>
+void map_partitionL( partitioner_view part, Fn fn ) {
+    int levels = omp_get_max_active_levels();
+    omp_set_max_active_levels( 2 );
+#pragma omp parallel num_threads( num_numa_node ) proc_bind( spread )
+    {
+	int k = omp_get_thread_num();
+	int threads = omp_node_thread( k+1 ) - omp_node_thread( k );
+	intT first = part.node_start( k ), last = part.node_start( k+1 );
+#pragma omp parallel for num_threads( threads ) proc_bind( close ) schedule( dynamic, 1 )
+	for( intT p=first; p < last; ++p )
+	    fn( p );
+    }
+    omp_set_max_active_levels( levels );
+}
+#define map_partition(vname,part,code)					\
+    {									\
+	map_partitionL( part, [&]( int vname ) { code } );		\
+    }
+
+template<typename Fn>
+void map_vertexL( partitioner_view part, Fn fn ) {
+    int levels = omp_get_max_active_levels();
+    omp_set_max_active_levels( 2 );
+#pragma omp parallel num_threads( num_numa_node ) proc_bind( spread )
+    {
+	int k = omp_get_thread_num();
+	int threads = omp_node_thread( k+1 ) - omp_node_thread( k );
+	intT vs = part.start_of( part.node_start( k ) );
+	intT ve = part.start_of( part.node_start( k+1 ) );
+#pragma omp parallel for num_threads( threads ) proc_bind( close ) schedule( dynamic, 2048 )
+	for( intT v=vs; v < ve; ++v )
+	    fn( v );
+    }
+    omp_set_max_active_levels( levels );
+}
+
+#else // NUMA_SCHED
+
 #if NUMA
+// The runtime runs iteration k on the workers of its k-th NUMA node,
+// which is node k of numa_nodes only when those are the physical nodes
+// 0..count()-1 (checked in parallel_main())
 template<typename Fn>
-void map_partitionL( const partitioner & part, Fn fn ) {
+void map_partitionL( partitioner_view part, Fn fn ) {
     PartitionOp<Fn> op( part, fn );
     __cilkrts_cilk_for_numa_64( &PartitionOp<Fn>::func,
 				reinterpret_cast<void *>( &op ),
@@ -348,7 +525,7 @@ void map_partitionL( const partitioner & part, Fn fn ) {
     }
 #else // not NUMA
 template<typename Fn>
-void map_partitionL( const partitioner & part, Fn fn ) {
+void map_partitionL( partitioner_view part, Fn fn ) {
     intT _np = part.get_num_partitions();
     parallel_for( intT vname=0; vname < _np; ++vname ) {
 	fn( vname );
@@ -365,7 +542,7 @@ void map_partitionL( const partitioner & part, Fn fn ) {
 
 #if NUMA
 template<typename Fn>
-void map_vertexL( const partitioner & part, Fn fn ) {
+void map_vertexL( partitioner_view part, Fn fn ) {
     VertexOp<Fn> op( part, fn );
     __cilkrts_cilk_for_numa_64( &VertexOp<Fn>::func,
 				reinterpret_cast<void *>( &op ),
@@ -374,7 +551,7 @@ void map_vertexL( const partitioner & part, Fn fn ) {
 }
 #else
 template<typename Fn>
-void map_vertexL( const partitioner & part, Fn fn ) {
+void map_vertexL( partitioner_view part, Fn fn ) {
 #if defined(CILK)
     _Pragma( STRINGIFY(cilk grainsize = _SCAN_BSIZE) ) parallel_for(
 	intT v=0; v < part.get_num_elements(); ++v )
@@ -386,6 +563,8 @@ void map_vertexL( const partitioner & part, Fn fn ) {
 }
 #endif
 
+#endif // NUMA_SCHED / OPENMP
+
 #define map_vertex(vname,part,code) 	 	 	 	 	\
     do { 	 	 	 			 	 	\
 	map_partition(_p,part, {					\
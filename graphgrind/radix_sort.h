@@ -0,0 +1,108 @@
+// -*- C++ -*-
+// Parallel LSD radix sort of 64-bit keys, optionally carrying a value per
+// key, used to sort the edges of COO partitions (see EdgeList in
+// graph-numa.h).
+//
+// Every pass sorts on RADIX_DIGIT bits: the keys are split in blocks that
+// count their digits in parallel, the counts are scanned digit-major, and
+// every block scatters its keys to its own range of each bucket, so the
+// sort is stable. Only the bits that may be set are sorted, and passes in
+// which all keys have the same digit are skipped. This file relies on
+// parallel.h having been included before.
+#ifndef RADIX_SORT_H
+#define RADIX_SORT_H
+
+#include <stdint.h>
+#include <algorithm>
+
+// Bits sorted per pass
+#ifndef RADIX_DIGIT
+#define RADIX_DIGIT 8
+#endif
+
+namespace radix_sort
+{
+
+static const int buckets = 1 << RADIX_DIGIT;
+// Keys per block counting and scattering in parallel
+static const size_t block = 1 << 16;
+
+// Number of bits needed for values below n
+inline int bits_for( uint64_t n )
+{
+    int b = 0;
+    while( b < 64 && ( n >> b ) > 1 )
+        ++b;
+    return ( n >> b ) ? b + 1 : b;
+}
+
+// Sort keys[0,n) on their bits lowest bits, and values with them if not
+// null. tkeys and tvalues are buffers of n elements; the result is left in
+// keys and values.
+template<class V>
+void sort( size_t n, int bits, uint64_t *keys, uint64_t *tkeys,
+           V *values, V *tvalues )
+{
+    size_t nb = ( n + block - 1 ) / block;
+    size_t *count = new size_t [nb*buckets];
+    uint64_t *src = keys, *dst = tkeys;
+    V *vsrc = values, *vdst = tvalues;
+    for( int shift=0; shift < bits; shift += RADIX_DIGIT )
+    {
+        parallel_range( (size_t)0, nb, 1, [&]( size_t b ) {
+            size_t *c = &count[b*buckets];
+            std::fill( c, c+buckets, (size_t)0 );
+            size_t e = std::min( n, ( b + 1 ) * block );
+            for( size_t i=b*block; i < e; ++i )
+                ++c[( src[i] >> shift ) & ( buckets - 1 )];
+        } );
+        // Skip the pass when all keys fall in one bucket
+        bool skip = false;
+        for( int d=0; d < buckets && !skip; ++d )
+        {
+            size_t t = 0;
+            for( size_t b=0; b < nb; ++b )
+                t += count[b*buckets+d];
+            if( t == n )
+                skip = true;
+            else if( t != 0 )
+                break;
+        }
+        if( skip )
+            continue;
+        size_t s = 0;
+        for( int d=0; d < buckets; ++d )
+            for( size_t b=0; b < nb; ++b )
+            {
+                size_t c = count[b*buckets+d];
+                count[b*buckets+d] = s;
+                s += c;
+            }
+        parallel_range( (size_t)0, nb, 1, [&]( size_t b ) {
+            size_t *c = &count[b*buckets];
+            size_t e = std::min( n, ( b + 1 ) * block );
+            for( size_t i=b*block; i < e; ++i )
+            {
+                size_t k = c[( src[i] >> shift ) & ( buckets - 1 )]++;
+                dst[k] = src[i];
+                if( vsrc )
+                    vdst[k] = vsrc[i];
+            }
+        } );
+        std::swap( src, dst );
+        std::swap( vsrc, vdst );
+    }
+    delete [] count;
+    if( src != keys )
+    {
+        parallel_range( (size_t)0, n, 4096, [&]( size_t i ) {
+            keys[i] = src[i];
+            if( vsrc )
+                values[i] = vsrc[i];
+        } );
+    }
+}
+
+} // namespace radix_sort
+
+#endif // RADIX_SORT_H
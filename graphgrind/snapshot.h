@@ -0,0 +1,205 @@
+// -*- C++ -*-
+// Binary snapshots of a partitioned graph (see partitioned_graph in
+// graph-numa.h and the -snap option).
+//
+// A snapshot starts with a header: a magic number, the format version and
+// a key made of a hash of the graph and the options the partitions depend
+// on. It is followed by arrays, each padded to 8 bytes. A snapshot is only
+// used when magic, version and key all match; otherwise the partitions are
+// rebuilt and the snapshot is written again.
+//
+// Snapshots are written to a temporary file that is renamed when
+// complete, so an interrupted run never leaves a truncated snapshot
+// behind. They are read through a read-only mapping of the whole file;
+// the arrays are copied from the mapping to memory on the NUMA nodes of
+// their partitions.
+//
+// This file relies on parallel.h having been included before.
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace snapshot
+{
+
+static const uint64_t magic = 0x50414e5347475247ULL; // "GRGGSNAP"
+// Increment on every change of the layout
+static const uint64_t version = 3;
+
+// Mix the word x into the hash h
+inline uint64_t mix( uint64_t h, uint64_t x )
+{
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return ( h ^ x ) * 0x9e3779b97f4a7c15ULL + 0x632be59bd9b4e019ULL;
+}
+
+// Hash of word(i) for i in [0,n): blocks are hashed in parallel and the
+// block hashes combined in order, so the result does not depend on the
+// number of threads.
+template<class Word>
+uint64_t hash( intT n, Word word )
+{
+    const intT bsize = 4096;
+    intT nb = ( n + bsize - 1 ) / bsize;
+    uint64_t *H = new uint64_t [nb];
+    parallel_range( (intT)0, nb, 1, [&]( intT b ) {
+        uint64_t h = b;
+        intT e = std::min( n, ( b + 1 ) * bsize );
+        for( intT i=b*bsize; i < e; ++i )
+            h = mix( h, word( i ) );
+        H[b] = h;
+    } );
+    uint64_t h = n;
+    for( intT b=0; b < nb; ++b )
+        h = mix( h, H[b] );
+    delete [] H;
+    return h;
+}
+
+class writer
+{
+    FILE *f;
+    std::string name, tmp;
+    uint64_t pos;
+    bool ok;
+
+    void raw( const void *data, size_t bytes )
+    {
+        if( ok && bytes && fwrite( data, 1, bytes, f ) != bytes )
+            ok = false;
+        pos += bytes;
+    }
+    void pad()
+    {
+        static const char zeros[8] = { 0 };
+        raw( zeros, ( 8 - pos % 8 ) % 8 );
+    }
+
+public:
+    writer( const char *fname, const std::vector<uint64_t> & key )
+        : name( fname ), tmp( name + ".tmp" ), pos( 0 )
+    {
+        f = fopen( tmp.c_str(), "wb" );
+        ok = f != 0;
+        put( magic );
+        put( version );
+        put( (uint64_t)key.size() );
+        array( &key[0], key.size() );
+    }
+
+    template<class T>
+    void put( const T & value )
+    {
+        array( &value, 1 );
+    }
+    template<class T>
+    void array( const T *data, size_t n )
+    {
+        raw( data, n * sizeof( T ) );
+        pad();
+    }
+
+    // Close the file and move it into place. Returns false on any error,
+    // in which case no snapshot is left behind.
+    bool close()
+    {
+        if( f && fclose( f ) != 0 )
+            ok = false;
+        f = 0;
+        if( ok && rename( tmp.c_str(), name.c_str() ) != 0 )
+            ok = false;
+        if( !ok )
+            unlink( tmp.c_str() );
+        return ok;
+    }
+};
+
+class reader
+{
+    const char *base;
+    size_t size, pos;
+    bool ok;
+
+public:
+    reader() : base( 0 ), size( 0 ), pos( 0 ), ok( false ) { }
+
+    // Map fname and check its header against key. Returns false if the
+    // file does not exist or does not match.
+    bool open( const char *fname, const std::vector<uint64_t> & key )
+    {
+        int fd = ::open( fname, O_RDONLY );
+        if( fd < 0 )
+            return false;
+        struct stat st;
+        if( fstat( fd, &st ) == 0 && st.st_size > 0 )
+        {
+            size = st.st_size;
+            void *m = mmap( 0, size, PROT_READ, MAP_SHARED, fd, 0 );
+            if( m != MAP_FAILED )
+            {
+                base = (const char *)m;
+                madvise( m, size, MADV_SEQUENTIAL );
+            }
+        }
+        ::close( fd );
+        if( !base )
+            return false;
+        ok = true;
+        uint64_t len = 0;
+        if( get<uint64_t>() != magic || get<uint64_t>() != version
+            || ( len = get<uint64_t>() ) != key.size() )
+            ok = false;
+        const uint64_t *k = array<uint64_t>( len );
+        if( ok && !std::equal( key.begin(), key.end(), k ) )
+            ok = false;
+        return ok;
+    }
+    void close()
+    {
+        if( base )
+            munmap( (void *)base, size );
+        base = 0;
+        ok = false;
+    }
+    // False once a read went past the end of the file
+    bool good() const
+    {
+        return ok;
+    }
+
+    template<class T>
+    T get()
+    {
+        const T *v = array<T>( 1 );
+        return ok ? *v : T();
+    }
+    // The next n elements, in the mapping
+    template<class T>
+    const T *array( size_t n )
+    {
+        size_t bytes = n * sizeof( T );
+        if( !ok || bytes > size - pos )
+        {
+            ok = false;
+            return 0;
+        }
+        const T *a = (const T *)( base + pos );
+        pos += ( bytes + 7 ) & ~size_t( 7 );
+        pos = std::min( pos, size );
+        return a;
+    }
+};
+
+} // namespace snapshot
+
+#endif // SNAPSHOT_H
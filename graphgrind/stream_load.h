@@ -0,0 +1,133 @@
+// -*- C++ -*-
+// Streaming load of mapped input files (option -stream, see
+// readGraphFromGalois() in IO.h).
+//
+// Without streaming, the loader reads the whole input before the graph is
+// partitioned. With it, the loader returns as soon as the vertices are
+// set up and a background thread reads the edge arrays of the mapped
+// files in chunks of STREAM_CHUNK bytes, in vertex order, while the
+// partitions are built. The partition builders call wait() for the end of
+// the edges of their vertex range, so a partition is built as soon as its
+// edges are in memory, while later ranges are still being read.
+//
+// Reading is sequential per file and, with several files (out- and
+// in-edges), the files are read at the same pace in vertex order. The
+// reader only decides the order in which pages are read: a mapped page
+// that has not been read yet is still read on first use, so a missing
+// wait() costs time, never correctness.
+#ifndef STREAM_LOAD_H
+#define STREAM_LOAD_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <algorithm>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Number of bytes read at a time by the streaming reader
+#ifndef STREAM_CHUNK
+#define STREAM_CHUNK (16 << 20)
+#endif
+
+namespace stream_load
+{
+
+class reader
+{
+    struct region
+    {
+        const char *base;
+        size_t len;
+        size_t done;    // bytes read from base
+    };
+    std::vector<region> regions;
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable progress;
+    bool started;
+
+    // Region least far along, relative to its size; -1 when all are read
+    int next_region()
+    {
+        int r = -1;
+        for( size_t i=0; i < regions.size(); ++i )
+            if( regions[i].done < regions[i].len
+                && ( r < 0 || (double)regions[i].done / regions[i].len
+                              < (double)regions[r].done / regions[r].len ) )
+                r = i;
+        return r;
+    }
+
+    void run()
+    {
+        long page = sysconf( _SC_PAGESIZE );
+        std::unique_lock<std::mutex> g( lock );
+        for( int r; ( r = next_region() ) >= 0; )
+        {
+            region & R = regions[r];
+            size_t s = R.done, e = std::min( R.len, s + STREAM_CHUNK );
+            g.unlock();
+            // Ask for the next chunk while this one is read
+            size_t a = ( e / page ) * page;
+            if( a < R.len )
+                madvise( (void *)( R.base + a ),
+                         std::min( R.len - a, (size_t)STREAM_CHUNK ),
+                         MADV_WILLNEED );
+            volatile char sink = 0;
+            for( size_t i=s; i < e; i += page )
+                sink = R.base[i];
+            sink = R.base[e-1];
+            (void)sink;
+            g.lock();
+            R.done = e;
+            progress.notify_all();
+        }
+    }
+
+public:
+    reader() : started( false ) { }
+    ~reader()
+    {
+        if( thread.joinable() )
+            thread.join();
+    }
+
+    // Read [p,p+len) in the background; call before start()
+    void add( const void *p, size_t len )
+    {
+        if( len > 0 )
+        {
+            region R = { (const char *)p, len, 0 };
+            regions.push_back( R );
+        }
+    }
+    void start()
+    {
+        started = true;
+        thread = std::thread( &reader::run, this );
+    }
+
+    // Wait until all bytes before p are read, if p is in a region
+    void wait( const void *p )
+    {
+        const char *c = (const char *)p;
+        std::unique_lock<std::mutex> g( lock );
+        for( size_t i=0; i < regions.size(); ++i )
+        {
+            region & R = regions[i];
+            if( c > R.base && c <= R.base + R.len )
+                progress.wait( g, [&]{ return R.base + R.done >= c; } );
+        }
+    }
+    void wait_all()
+    {
+        if( started && thread.joinable() )
+            thread.join();
+    }
+};
+
+} // namespace stream_load
+
+#endif // STREAM_LOAD_H
@@ -148,11 +148,11 @@ class FDense
     intT _ee = _e;					\
     intT _n = _ee-_ss;					\
     intT _l = nblocks(_n,_bsize);			\
-    parallel_for (intT _i = 0; _i < _l; _i++) {		\
+    parallel_range( (intT)0, _l, 1, [&]( intT _i ) {	\
       intT _s = _ss + _i * (_bsize);			\
       intT _e = min(_s + (_bsize), _ee);		\
       _body						\
-	}						\
+	} );						\
   }
 
 template <class OT, class intT, class F, class G>
@@ -410,7 +410,7 @@ template <class ET, class intT, class PRED>
 intT filter(ET* In, ET* Out, intT n, PRED p)
 {
     bool *Fl = new bool [n];
-    _Pragma( STRINGIFY(cilk grainsize = _F_BSIZE) ) parallel_for (intT i=0; i < n; i++) Fl[i] = (bool) p(In[i]);
+    parallel_range( (intT)0, n, _F_BSIZE, [&]( intT i ) { Fl[i] = (bool) p(In[i]); } );
     intT  m = pack(In, Out, Fl, n);
     delete [] Fl;
     return m;
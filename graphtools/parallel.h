@@ -47,3 +47,16 @@ typedef int intT;
 typedef unsigned int uintT;
 #define INT_T_MAX INT_MAX
 #endif
+
+// parallel.h has no include guard, so guard the definition.
+#ifndef PARALLEL_RANGE_DEFINED
+#define PARALLEL_RANGE_DEFINED
+// parallel_range( lo, hi, grain, body ): body(i) for every i in [lo,hi),
+// in parallel (as in graphgrind/parallel.h, used by csr_transpose.h)
+template<class I, class Body>
+inline void parallel_range( I lo, I hi, long grain, Body body )
+{
+    parallel_for( I i=lo; i < hi; ++i )
+        body( i );
+}
+#endif // PARALLEL_RANGE_DEFINED